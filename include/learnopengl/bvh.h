@@ -0,0 +1,380 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/frustum_culling.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+// One node of a Bvh, 32 bytes so two share a cache line. Inner nodes have count 0 and their children at first
+// and first + 1, leaves hold count primitives starting at first in the tree's primitive order.
+struct BvhNode {
+    glm::vec3 min;
+    uint32_t first;
+    glm::vec3 max;
+    uint32_t count;
+};
+
+static_assert(sizeof(BvhNode) == 32, "BvhNode is meant to fill half a cache line");
+
+// Bounding volume hierarchy over world space boxes, for the scene queries: which boxes are in a frustum, near a
+// point or under a ray. Built top down with the surface area heuristic over binned centroids and stored flattened
+// in one array, every parent before its children. When boxes move without the scene changing, SetBox and Refit
+// update the node bounds in one backwards pass instead of building again; the tree only gets looser.
+class Bvh
+{
+public:
+    // builds the tree over boxes, primitive i of the queries is boxes[i]
+    void Build(const vector<Aabb> &boxes)
+    {
+        this->boxes = boxes;
+        centroids.resize(boxes.size());
+        order.resize(boxes.size());
+        for (uint32_t i = 0; i < boxes.size(); i++)
+        {
+            centroids[i] = (boxes[i].min + boxes[i].max) * 0.5f;
+            order[i] = i;
+        }
+        nodes.clear();
+        if (boxes.empty())
+            return;
+        nodes.reserve(boxes.size() * 2);
+        nodes.push_back({glm::vec3(0.0f), 0, glm::vec3(0.0f), (uint32_t)boxes.size()});
+        subdivide(0, 0);
+        leafBoxes.Resize(boxes.size());
+        for (uint32_t i = 0; i < boxes.size(); i++)
+            leafBoxes.Set(i, boxes[order[i]]);
+    }
+
+    // moves a primitive, the nodes above it are only updated by the next Refit
+    void SetBox(unsigned int primitive, const Aabb &box)
+    {
+        boxes[primitive] = box;
+    }
+
+    // recomputes the bounds of every node from its primitives or children
+    void Refit()
+    {
+        for (size_t i = nodes.size(); i-- > 0;)
+        {
+            BvhNode &node = nodes[i];
+            if (node.count > 0)
+            {
+                fitLeaf(node);
+                for (uint32_t j = node.first; j < node.first + node.count; j++)
+                    leafBoxes.Set(j, boxes[order[j]]);
+            }
+            else
+            {
+                const BvhNode &left = nodes[node.first], &right = nodes[node.first + 1];
+                node.min = glm::min(left.min, right.min);
+                node.max = glm::max(left.max, right.max);
+            }
+        }
+    }
+
+    // calls visit(primitive) for every box at least partly inside the frustum. Planes a node lies fully inside
+    // are not tested again below it, subtrees inside all of them are visited without any test. The primitives of
+    // a leaf, at most MAX_LEAF_PRIMITIVES as a rule, are tested four at a time
+    template<class Visit>
+    void QueryFrustum(const Frustum &frustum, Visit visit) const
+    {
+        if (nodes.empty())
+            return;
+        const unsigned int allPlanes = (1u << 6) - 1;
+        StackEntry stack[MAX_DEPTH + 2];
+        int size = 0;
+        stack[size++] = {0, allPlanes};
+        while (size > 0)
+        {
+            StackEntry entry = stack[--size];
+            const BvhNode &node = nodes[entry.node];
+            unsigned int planes = entry.planes;
+            if (planes && !insidePlanes(frustum, node.min, node.max, planes))
+                continue;
+            if (node.count == 0)
+            {
+                stack[size++] = {node.first + 1, planes};
+                stack[size++] = {node.first, planes};
+                continue;
+            }
+            uint32_t end = node.first + node.count;
+            for (uint32_t i = node.first; i < end; i += 4)
+            {
+                unsigned int inside = planes ? leafBoxes.Inside4(frustum, planes, i) : 0xfu;
+                for (uint32_t lane = 0; lane < 4 && i + lane < end; lane++)
+                    if (inside & (1u << lane))
+                        visit(order[i + lane]);
+            }
+        }
+    }
+
+    // calls visit(primitive) for every box the sphere touches
+    template<class Visit>
+    void QuerySphere(const glm::vec3 &center, float radius, Visit visit) const
+    {
+        if (nodes.empty())
+            return;
+        float radiusSquared = radius * radius;
+        uint32_t stack[MAX_DEPTH + 2];
+        int size = 0;
+        stack[size++] = 0;
+        while (size > 0)
+        {
+            const BvhNode &node = nodes[stack[--size]];
+            if (distanceSquared(center, node.min, node.max) > radiusSquared)
+                continue;
+            if (node.count == 0)
+            {
+                stack[size++] = node.first + 1;
+                stack[size++] = node.first;
+                continue;
+            }
+            for (uint32_t i = node.first; i < node.first + node.count; i++)
+                if (distanceSquared(center, boxes[order[i]].min, boxes[order[i]].max) <= radiusSquared)
+                    visit(order[i]);
+        }
+    }
+
+    // finds the nearest primitive along the ray up to maxDistance. hit(primitive, boxDistance) is asked for every
+    // box the ray enters, in roughly front to back order, and returns the distance of the actual hit or a negative
+    // value for a miss; returning boxDistance picks by box. Nodes behind the nearest hit so far are skipped
+    template<class Hit>
+    bool Raycast(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance, Hit hit,
+                 unsigned int &primitive, float &distance) const
+    {
+        distance = maxDistance;
+        bool found = false;
+        if (nodes.empty())
+            return false;
+        glm::vec3 inverse = glm::vec3(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+        uint32_t stack[MAX_DEPTH + 2];
+        int size = 0;
+        stack[size++] = 0;
+        while (size > 0)
+        {
+            const BvhNode &node = nodes[stack[--size]];
+            float entry;
+            if (!slab(origin, inverse, node.min, node.max, distance, entry))
+                continue;
+            if (node.count == 0)
+            {
+                // the nearer child goes on top, so it is searched first and shortens the ray for the other
+                float leftEntry, rightEntry;
+                const BvhNode &left = nodes[node.first], &right = nodes[node.first + 1];
+                bool hitLeft = slab(origin, inverse, left.min, left.max, distance, leftEntry);
+                bool hitRight = slab(origin, inverse, right.min, right.max, distance, rightEntry);
+                if (hitLeft && hitRight)
+                {
+                    bool leftFirst = leftEntry <= rightEntry;
+                    stack[size++] = leftFirst ? node.first + 1 : node.first;
+                    stack[size++] = leftFirst ? node.first : node.first + 1;
+                }
+                else if (hitLeft || hitRight)
+                    stack[size++] = hitLeft ? node.first : node.first + 1;
+                continue;
+            }
+            for (uint32_t i = node.first; i < node.first + node.count; i++)
+            {
+                float boxEntry;
+                if (!slab(origin, inverse, boxes[order[i]].min, boxes[order[i]].max, distance, boxEntry))
+                    continue;
+                float t = hit(order[i], boxEntry);
+                if (t >= 0.0f && t < distance)
+                {
+                    distance = t;
+                    primitive = order[i];
+                    found = true;
+                }
+            }
+        }
+        return found;
+    }
+
+    unsigned int PrimitiveCount() const { return (unsigned int)boxes.size(); }
+    unsigned int NodeCount() const { return (unsigned int)nodes.size(); }
+    const Aabb &Box(unsigned int primitive) const { return boxes[primitive]; }
+
+private:
+    // leaves are made at this depth whatever their size, it bounds the query stacks
+    static const int MAX_DEPTH = 64;
+    static const int BINS = 16;
+    // a node with up to this many primitives becomes a leaf when no split is cheaper than testing them all
+    static const uint32_t MAX_LEAF_PRIMITIVES = 4;
+
+    struct StackEntry {
+        uint32_t node;
+        unsigned int planes;   // bit i set while plane i still has to be tested
+    };
+
+    vector<BvhNode> nodes;
+    vector<Aabb> boxes;
+    vector<glm::vec3> centroids;
+    vector<uint32_t> order;    // primitives in leaf order
+    BoxArrays leafBoxes;       // their boxes in the same order, for the frustum test
+
+    static float area(const glm::vec3 &min, const glm::vec3 &max)
+    {
+        glm::vec3 size = max - min;
+        return size.x * size.y + size.y * size.z + size.z * size.x;
+    }
+
+    void fitLeaf(BvhNode &node) const
+    {
+        node.min = glm::vec3(FLT_MAX);
+        node.max = glm::vec3(-FLT_MAX);
+        for (uint32_t i = node.first; i < node.first + node.count; i++)
+        {
+            node.min = glm::min(node.min, boxes[order[i]].min);
+            node.max = glm::max(node.max, boxes[order[i]].max);
+        }
+    }
+
+    void subdivide(uint32_t index, int depth)
+    {
+        fitLeaf(nodes[index]);
+        uint32_t first = nodes[index].first, count = nodes[index].count;
+        if (count <= 1 || depth >= MAX_DEPTH)
+            return;
+
+        glm::vec3 centroidMin(FLT_MAX), centroidMax(-FLT_MAX);
+        for (uint32_t i = first; i < first + count; i++)
+        {
+            centroidMin = glm::min(centroidMin, centroids[order[i]]);
+            centroidMax = glm::max(centroidMax, centroids[order[i]]);
+        }
+
+        // the cheapest split over all axes, counting the cost of a node as primitives times surface area
+        float bestCost = FLT_MAX;
+        int bestAxis = -1, bestSplit = 0;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float extent = centroidMax[axis] - centroidMin[axis];
+            if (extent <= 0.0f)
+                continue;
+            glm::vec3 binMin[BINS], binMax[BINS];
+            uint32_t binCount[BINS] = {};
+            for (int bin = 0; bin < BINS; bin++)
+            {
+                binMin[bin] = glm::vec3(FLT_MAX);
+                binMax[bin] = glm::vec3(-FLT_MAX);
+            }
+            float scale = BINS / extent;
+            for (uint32_t i = first; i < first + count; i++)
+            {
+                const Aabb &box = boxes[order[i]];
+                int bin = binOf(centroids[order[i]][axis], centroidMin[axis], scale);
+                binCount[bin]++;
+                binMin[bin] = glm::min(binMin[bin], box.min);
+                binMax[bin] = glm::max(binMax[bin], box.max);
+            }
+            // sweep from the right to get the cost of everything right of each split plane, then from the left
+            float rightArea[BINS];
+            uint32_t rightCount[BINS];
+            glm::vec3 sweepMin(FLT_MAX), sweepMax(-FLT_MAX);
+            uint32_t sweepCount = 0;
+            for (int bin = BINS - 1; bin > 0; bin--)
+            {
+                sweepCount += binCount[bin];
+                sweepMin = glm::min(sweepMin, binMin[bin]);
+                sweepMax = glm::max(sweepMax, binMax[bin]);
+                rightCount[bin] = sweepCount;
+                rightArea[bin] = sweepCount ? area(sweepMin, sweepMax) : 0.0f;
+            }
+            sweepMin = glm::vec3(FLT_MAX);
+            sweepMax = glm::vec3(-FLT_MAX);
+            sweepCount = 0;
+            for (int split = 1; split < BINS; split++)
+            {
+                sweepCount += binCount[split - 1];
+                sweepMin = glm::min(sweepMin, binMin[split - 1]);
+                sweepMax = glm::max(sweepMax, binMax[split - 1]);
+                if (sweepCount == 0 || rightCount[split] == 0)
+                    continue;
+                float cost = sweepCount * area(sweepMin, sweepMax) + rightCount[split] * rightArea[split];
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = split;
+                }
+            }
+        }
+        if (bestAxis < 0)
+            return;
+        float leafCost = count * area(nodes[index].min, nodes[index].max);
+        if (bestCost >= leafCost && count <= MAX_LEAF_PRIMITIVES)
+            return;
+
+        float scale = BINS / (centroidMax[bestAxis] - centroidMin[bestAxis]);
+        uint32_t *middle = std::partition(&order[first], &order[first] + count, [&](uint32_t primitive) {
+            return binOf(centroids[primitive][bestAxis], centroidMin[bestAxis], scale) < bestSplit;
+        });
+        uint32_t leftCount = (uint32_t)(middle - &order[first]);
+        if (leftCount == 0 || leftCount == count)
+            return;
+
+        uint32_t left = (uint32_t)nodes.size();
+        nodes.push_back({glm::vec3(0.0f), first, glm::vec3(0.0f), leftCount});
+        nodes.push_back({glm::vec3(0.0f), first + leftCount, glm::vec3(0.0f), count - leftCount});
+        nodes[index].first = left;
+        nodes[index].count = 0;
+        subdivide(left, depth + 1);
+        subdivide(left + 1, depth + 1);
+    }
+
+    static int binOf(float centroid, float min, float scale)
+    {
+        return std::min(BINS - 1, (int)((centroid - min) * scale));
+    }
+
+    // tests a box against the planes still set in planes, clears the ones it lies fully inside of.
+    // false as soon as it is fully outside one
+    static bool insidePlanes(const Frustum &frustum, const glm::vec3 &min, const glm::vec3 &max, unsigned int &planes)
+    {
+        glm::vec3 center = (min + max) * 0.5f, extent = (max - min) * 0.5f;
+        for (int i = 0; i < 6; i++)
+        {
+            if (!(planes & (1u << i)))
+                continue;
+            const glm::vec4 &plane = frustum.planes[i];
+            float distance = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+            float reach = fabs(plane.x) * extent.x + fabs(plane.y) * extent.y + fabs(plane.z) * extent.z;
+            if (distance + reach < 0.0f)
+                return false;
+            if (distance - reach >= 0.0f)
+                planes &= ~(1u << i);
+        }
+        return true;
+    }
+
+    static float distanceSquared(const glm::vec3 &point, const glm::vec3 &min, const glm::vec3 &max)
+    {
+        glm::vec3 offset = point - glm::clamp(point, min, max);
+        return glm::dot(offset, offset);
+    }
+
+    // slab test, entry is where the ray enters the box (0 when it starts inside)
+    static bool slab(const glm::vec3 &origin, const glm::vec3 &inverse, const glm::vec3 &min, const glm::vec3 &max,
+                     float maxDistance, float &entry)
+    {
+        float tNear = 0.0f, tFar = maxDistance;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float t0 = (min[axis] - origin[axis]) * inverse[axis];
+            float t1 = (max[axis] - origin[axis]) * inverse[axis];
+            tNear = std::max(tNear, std::min(t0, t1));
+            tFar = std::min(tFar, std::max(t0, t1));
+        }
+        entry = tNear;
+        return tNear <= tFar;
+    }
+};
+#endif
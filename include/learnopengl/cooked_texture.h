@@ -0,0 +1,348 @@
+#ifndef COOKED_TEXTURE_H
+#define COOKED_TEXTURE_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+using namespace std;
+
+// Container for textures cooked offline by texture_cooker (written next to the source as <image>.rgtex).
+// Layout:
+//   CookedTextureHeader
+//   CookedLevel[levelCount], level 0 is the full size image
+//   block compressed data of all levels, every level starts 8 byte aligned
+// Textures without alpha are stored as BC1 (DXT1), textures with alpha as BC3 (DXT5).
+const char COOKED_TEXTURE_MAGIC[4] = {'R', 'G', 'T', 'X'};
+const uint32_t COOKED_TEXTURE_VERSION = 1;
+
+const uint32_t COOKED_FORMAT_BC1 = 1;
+const uint32_t COOKED_FORMAT_BC3 = 3;
+
+// set when the rows were flipped like stbi_set_flip_vertically_on_load(true) does
+const uint32_t COOKED_FLIPPED_VERTICALLY = 1;
+
+struct CookedTextureHeader {
+    char     magic[4];
+    uint32_t version;
+    uint32_t format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t levelCount;
+    uint32_t flags;
+    uint32_t reserved;
+};
+
+struct CookedLevel {
+    uint32_t width;
+    uint32_t height;
+    uint64_t offset; // from the start of the data block
+    uint64_t size;
+};
+
+struct CookedTexture {
+    uint32_t format = 0;
+    uint32_t flags = 0;
+    vector<CookedLevel> levels;
+    vector<unsigned char> data;
+};
+
+inline string cookedPathFor(const string &sourcePath)
+{
+    return sourcePath + ".rgtex";
+}
+
+// a cooked file is only used while it is newer than its source image
+inline bool cookedTextureUpToDate(const string &sourcePath, const string &cookedPath)
+{
+    struct stat sourceStat, cookedStat;
+    return stat(sourcePath.c_str(), &sourceStat) == 0 && stat(cookedPath.c_str(), &cookedStat) == 0
+           && cookedStat.st_mtime >= sourceStat.st_mtime;
+}
+
+// bytes of one level of width x height in the given format, whole 4x4 blocks
+inline uint64_t cookedLevelBytes(uint32_t format, uint32_t width, uint32_t height)
+{
+    return (uint64_t)((width + 3) / 4) * ((height + 3) / 4) * (format == COOKED_FORMAT_BC1 ? 8 : 16);
+}
+
+// fails for files that are damaged, cut short, or cooked for the other orientation than flippedVertically,
+// the caller decodes the source image instead then
+inline bool readCookedTexture(const string &path, CookedTexture &texture, bool flippedVertically)
+{
+    ifstream in(path, ios::binary | ios::ate);
+    if (!in)
+        return false;
+    uint64_t fileSize = (uint64_t)in.tellg();
+    in.seekg(0);
+    CookedTextureHeader header;
+    if (!in.read((char*)&header, sizeof(header)) || memcmp(header.magic, COOKED_TEXTURE_MAGIC, sizeof(header.magic)) != 0
+        || header.version != COOKED_TEXTURE_VERSION || header.levelCount == 0 || header.levelCount > 32
+        || (header.format != COOKED_FORMAT_BC1 && header.format != COOKED_FORMAT_BC3)
+        || ((header.flags & COOKED_FLIPPED_VERTICALLY) != 0) != flippedVertically)
+        return false;
+    uint64_t tableBytes = sizeof(header) + (uint64_t)header.levelCount * sizeof(CookedLevel);
+    if (fileSize < tableBytes)
+        return false;
+    texture.format = header.format;
+    texture.flags = header.flags;
+    texture.levels.resize(header.levelCount);
+    if (!in.read((char*)texture.levels.data(), texture.levels.size() * sizeof(CookedLevel)))
+        return false;
+    // every level has to lie inside the data block and hold exactly the blocks of its size
+    uint64_t dataBytes = fileSize - tableBytes, end = 0;
+    for (const CookedLevel &level : texture.levels)
+    {
+        if (level.width == 0 || level.height == 0 || level.offset > dataBytes || level.size > dataBytes - level.offset
+            || level.size != cookedLevelBytes(header.format, level.width, level.height))
+            return false;
+        end = std::max(end, level.offset + level.size);
+    }
+    texture.data.resize((size_t)end);
+    return (bool)in.read((char*)texture.data.data(), texture.data.size());
+}
+
+// ------------------------------------------------------------------------
+// encoding, only used by the offline cooker
+
+inline uint16_t packColor565(const float color[3])
+{
+    int r = (int)std::lround(std::min(std::max(color[0], 0.0f), 255.0f) * 31.0f / 255.0f);
+    int g = (int)std::lround(std::min(std::max(color[1], 0.0f), 255.0f) * 63.0f / 255.0f);
+    int b = (int)std::lround(std::min(std::max(color[2], 0.0f), 255.0f) * 31.0f / 255.0f);
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+inline void unpackColor565(uint16_t packed, int color[3])
+{
+    color[0] = ((packed >> 11) & 31) * 255 / 31;
+    color[1] = ((packed >> 5) & 63) * 255 / 63;
+    color[2] = (packed & 31) * 255 / 31;
+}
+
+// block is 16 RGBA pixels in row major order, the endpoints are picked along the principal axis of the colors
+inline void encodeBC1Block(const unsigned char block[64], unsigned char out[8])
+{
+    float mean[3] = {0.0f, 0.0f, 0.0f};
+    for (int i = 0; i < 16; i++)
+        for (int c = 0; c < 3; c++)
+            mean[c] += block[i * 4 + c] / 16.0f;
+    float covariance[6] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+    for (int i = 0; i < 16; i++)
+    {
+        float r = block[i * 4] - mean[0], g = block[i * 4 + 1] - mean[1], b = block[i * 4 + 2] - mean[2];
+        covariance[0] += r * r; covariance[1] += r * g; covariance[2] += r * b;
+        covariance[3] += g * g; covariance[4] += g * b; covariance[5] += b * b;
+    }
+    // power iteration for the dominant eigenvector
+    float axis[3] = {1.0f, 1.0f, 1.0f};
+    for (int iteration = 0; iteration < 8; iteration++)
+    {
+        float next[3] = {
+            covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2],
+            covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2],
+            covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2]};
+        float length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+        if (length < 1e-6f)
+            break;
+        for (int c = 0; c < 3; c++)
+            axis[c] = next[c] / length;
+    }
+    float minProjection = 1e30f, maxProjection = -1e30f;
+    for (int i = 0; i < 16; i++)
+    {
+        float projection = 0.0f;
+        for (int c = 0; c < 3; c++)
+            projection += (block[i * 4 + c] - mean[c]) * axis[c];
+        minProjection = std::min(minProjection, projection);
+        maxProjection = std::max(maxProjection, projection);
+    }
+    float maxColor[3], minColor[3];
+    for (int c = 0; c < 3; c++)
+    {
+        maxColor[c] = mean[c] + axis[c] * maxProjection;
+        minColor[c] = mean[c] + axis[c] * minProjection;
+    }
+    uint16_t color0 = packColor565(maxColor), color1 = packColor565(minColor);
+    if (color0 < color1)
+        std::swap(color0, color1);
+
+    uint32_t indices = 0;
+    if (color0 != color1)
+    {
+        // four color mode (color0 > color1): color0, color1, 2/3 color0 + 1/3 color1, 1/3 color0 + 2/3 color1
+        int palette[4][3];
+        unpackColor565(color0, palette[0]);
+        unpackColor565(color1, palette[1]);
+        for (int c = 0; c < 3; c++)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        for (int i = 0; i < 16; i++)
+        {
+            int best = 0, bestError = 1 << 30;
+            for (int p = 0; p < 4; p++)
+            {
+                int error = 0;
+                for (int c = 0; c < 3; c++)
+                {
+                    int difference = block[i * 4 + c] - palette[p][c];
+                    error += difference * difference;
+                }
+                if (error < bestError)
+                {
+                    bestError = error;
+                    best = p;
+                }
+            }
+            indices |= (uint32_t)best << (2 * i);
+        }
+    }
+    out[0] = (unsigned char)(color0 & 0xff);
+    out[1] = (unsigned char)(color0 >> 8);
+    out[2] = (unsigned char)(color1 & 0xff);
+    out[3] = (unsigned char)(color1 >> 8);
+    for (int i = 0; i < 4; i++)
+        out[4 + i] = (unsigned char)(indices >> (8 * i));
+}
+
+// interpolated alpha block followed by a BC1 color block
+inline void encodeBC3Block(const unsigned char block[64], unsigned char out[16])
+{
+    int alpha0 = 0, alpha1 = 255;
+    for (int i = 0; i < 16; i++)
+    {
+        alpha0 = std::max(alpha0, (int)block[i * 4 + 3]);
+        alpha1 = std::min(alpha1, (int)block[i * 4 + 3]);
+    }
+    uint64_t indices = 0;
+    if (alpha0 != alpha1)
+    {
+        // eight alpha mode (alpha0 > alpha1): alpha0, alpha1 and six values evenly in between
+        int palette[8] = {alpha0, alpha1};
+        for (int p = 1; p < 7; p++)
+            palette[p + 1] = ((7 - p) * alpha0 + p * alpha1) / 7;
+        for (int i = 0; i < 16; i++)
+        {
+            int best = 0, bestError = 1 << 30;
+            for (int p = 0; p < 8; p++)
+            {
+                int error = std::abs((int)block[i * 4 + 3] - palette[p]);
+                if (error < bestError)
+                {
+                    bestError = error;
+                    best = p;
+                }
+            }
+            indices |= (uint64_t)best << (3 * i);
+        }
+    }
+    out[0] = (unsigned char)alpha0;
+    out[1] = (unsigned char)alpha1;
+    for (int i = 0; i < 6; i++)
+        out[2 + i] = (unsigned char)(indices >> (8 * i));
+    encodeBC1Block(block, out + 8);
+}
+
+// compresses one RGBA8 image, edge blocks repeat the last row and column
+inline vector<unsigned char> compressImage(const vector<unsigned char> &rgba, int width, int height, uint32_t format)
+{
+    const int blockBytes = format == COOKED_FORMAT_BC1 ? 8 : 16;
+    const int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+    vector<unsigned char> compressed((size_t)cookedLevelBytes(format, (uint32_t)width, (uint32_t)height));
+    unsigned char block[64];
+    for (int by = 0; by < blocksY; by++)
+        for (int bx = 0; bx < blocksX; bx++)
+        {
+            for (int y = 0; y < 4; y++)
+                for (int x = 0; x < 4; x++)
+                {
+                    int sx = std::min(bx * 4 + x, width - 1), sy = std::min(by * 4 + y, height - 1);
+                    memcpy(block + (y * 4 + x) * 4, &rgba[((size_t)sy * width + sx) * 4], 4);
+                }
+            unsigned char *out = &compressed[((size_t)by * blocksX + bx) * blockBytes];
+            if (format == COOKED_FORMAT_BC1)
+                encodeBC1Block(block, out);
+            else
+                encodeBC3Block(block, out);
+        }
+    return compressed;
+}
+
+// 2x2 box filter, odd sizes clamp at the border
+inline vector<unsigned char> downsampleImage(const vector<unsigned char> &rgba, int width, int height, int &nextWidth, int &nextHeight)
+{
+    nextWidth = std::max(width / 2, 1);
+    nextHeight = std::max(height / 2, 1);
+    vector<unsigned char> next((size_t)nextWidth * nextHeight * 4);
+    for (int y = 0; y < nextHeight; y++)
+        for (int x = 0; x < nextWidth; x++)
+        {
+            int x0 = std::min(x * 2, width - 1), x1 = std::min(x * 2 + 1, width - 1);
+            int y0 = std::min(y * 2, height - 1), y1 = std::min(y * 2 + 1, height - 1);
+            for (int c = 0; c < 4; c++)
+            {
+                int sum = rgba[((size_t)y0 * width + x0) * 4 + c] + rgba[((size_t)y0 * width + x1) * 4 + c]
+                          + rgba[((size_t)y1 * width + x0) * 4 + c] + rgba[((size_t)y1 * width + x1) * 4 + c];
+                next[((size_t)y * nextWidth + x) * 4 + c] = (unsigned char)((sum + 2) / 4);
+            }
+        }
+    return next;
+}
+
+// compresses the image with its full mip chain and writes the container
+inline bool writeCookedTexture(const string &path, vector<unsigned char> rgba, int width, int height, bool hasAlpha, uint32_t flags)
+{
+    CookedTextureHeader header;
+    memcpy(header.magic, COOKED_TEXTURE_MAGIC, sizeof(header.magic));
+    header.version = COOKED_TEXTURE_VERSION;
+    header.format = hasAlpha ? COOKED_FORMAT_BC3 : COOKED_FORMAT_BC1;
+    header.width = (uint32_t)width;
+    header.height = (uint32_t)height;
+    header.flags = flags;
+    header.reserved = 0;
+
+    vector<CookedLevel> levels;
+    vector<unsigned char> data;
+    for (;;)
+    {
+        vector<unsigned char> compressed = compressImage(rgba, width, height, header.format);
+        CookedLevel level;
+        level.width = (uint32_t)width;
+        level.height = (uint32_t)height;
+        level.offset = (data.size() + 7) & ~(uint64_t)7;
+        level.size = compressed.size();
+        data.resize(level.offset);
+        data.insert(data.end(), compressed.begin(), compressed.end());
+        levels.push_back(level);
+        if (width == 1 && height == 1)
+            break;
+        rgba = downsampleImage(rgba, width, height, width, height);
+    }
+    header.levelCount = (uint32_t)levels.size();
+
+    string tempPath = path + ".tmp";
+    {
+        ofstream out(tempPath, ios::binary | ios::trunc);
+        out.write((const char*)&header, sizeof(header));
+        out.write((const char*)levels.data(), levels.size() * sizeof(CookedLevel));
+        out.write((const char*)data.data(), data.size());
+        if (!out)
+        {
+            out.close();
+            remove(tempPath.c_str());
+            return false;
+        }
+    }
+    return rename(tempPath.c_str(), path.c_str()) == 0;
+}
+#endif
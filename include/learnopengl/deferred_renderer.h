@@ -0,0 +1,322 @@
+#ifndef DEFERRED_RENDERER_H
+#define DEFERRED_RENDERER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/render_state.h>
+#include <learnopengl/scene_uniforms.h>
+#include <learnopengl/shader_m.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+// one point or spot light of the deferred path, read as vertex attributes 1 to 6 of resources/shaders/deferred_light.vs.
+// Point lights have cut offs below -1, which leave the cone factor at 1 everywhere
+struct LightVolume {
+    glm::vec3 position;  float radius;
+    glm::vec3 ambient;   float constant;
+    glm::vec3 diffuse;   float linear;
+    glm::vec3 specular;  float quadratic;
+    glm::vec3 direction; float cutOff;
+    float outerCutOff;   float pad0, pad1, pad2;
+};
+
+static_assert(sizeof(LightVolume) == 96, "LightVolume is read as five vec4 and one float vertex attribute");
+
+// the sphere of a light that does not fall off is cut at this radius, far enough to cover any scene while its
+// vertices stay finite
+const float LIGHT_VOLUME_MAX_RADIUS = 1.0e4f;
+
+// a light too dim to make a visible difference anywhere gets a radius of 0, such volumes are not worth drawing
+inline LightVolume pointLightVolume(const PointLightBlock &light)
+{
+    LightVolume volume;
+    volume.position = light.position;
+    volume.radius = std::min(pointLightRange(light), LIGHT_VOLUME_MAX_RADIUS);
+    volume.ambient = light.ambient;
+    volume.constant = light.constant;
+    volume.diffuse = light.diffuse;
+    volume.linear = light.linear;
+    volume.specular = light.specular;
+    volume.quadratic = light.quadratic;
+    volume.direction = glm::vec3(0.0f, -1.0f, 0.0f);
+    volume.cutOff = -2.0f;
+    volume.outerCutOff = -3.0f;
+    volume.pad0 = volume.pad1 = volume.pad2 = 0.0f;
+    return volume;
+}
+
+// the sphere around a spot light is its whole reach, the cone is left to the shader
+inline LightVolume spotLightVolume(const SpotLightBlock &light)
+{
+    PointLightBlock reach;
+    reach.position = light.position;
+    reach.ambient = light.ambient;
+    reach.diffuse = light.diffuse;
+    reach.specular = light.specular;
+    reach.constant = light.constant;
+    reach.linear = light.linear;
+    reach.quadratic = light.quadratic;
+    reach.pad0 = 0.0f;
+    LightVolume volume = pointLightVolume(reach);
+    volume.direction = light.direction;
+    volume.cutOff = light.cutOff;
+    volume.outerCutOff = light.outerCutOff;
+    return volume;
+}
+
+// Deferred shading for scenes with many lights, with GL 3.3 and no compute shaders.
+//
+// The lit models draw into a G-buffer first (resources/shaders/gbuffer.fs): albedo with a specular intensity in
+// one RGBA8 target, the normal octahedron encoded in an RG16 target, and the depth, from which the lighting
+// shaders reconstruct the position. Resolve copies that depth into the default framebuffer, so the forward
+// passes after it depth test against the deferred surfaces, and lights the default framebuffer: the directional
+// light in one fullscreen pass, then every point and spot light as an instanced sphere around its reach, whose
+// back faces are drawn where they lie behind a surface and added up. A light only costs the pixels it can reach,
+// however many lanterns there are.
+//
+// Needs a current GL context when constructed; the shaders are resources/shaders/hiz_downsample.vs with
+// deferred_directional.fs, and deferred_light.
+class DeferredRenderer
+{
+public:
+    DeferredRenderer(Shader &directionalShader, Shader &volumeShader)
+        : directionalShader(directionalShader), volumeShader(volumeShader)
+    {
+        for (Shader *shader : {&directionalShader, &volumeShader})
+        {
+            shader->use();
+            shader->setInt("gAlbedoSpecular", 0);
+            shader->setInt("gNormal", 1);
+            shader->setInt("gDepth", 2);
+        }
+        directionalInverseUniform = directionalShader.uniform("inverseViewProjection");
+        directionalScreenUniform = directionalShader.uniform("screenSize");
+        volumeInverseUniform = volumeShader.uniform("inverseViewProjection");
+        volumeScreenUniform = volumeShader.uniform("screenSize");
+
+        glGenFramebuffers(1, &gBufferFBO);
+        glGenVertexArrays(1, &emptyVAO);
+        createSphere();
+        renderState().Invalidate();
+    }
+
+    DeferredRenderer(const DeferredRenderer &) = delete;
+    DeferredRenderer &operator=(const DeferredRenderer &) = delete;
+
+    // the specular exponent of the lit models, as material.shininess of object_lighting.fs
+    void SetShininess(float shininess)
+    {
+        directionalShader.use();
+        directionalShader.setFloat("shininess", shininess);
+        volumeShader.use();
+        volumeShader.setFloat("shininess", shininess);
+    }
+
+    // binds and clears the G-buffer for a width x height framebuffer; the geometry pass draws without blending,
+    // its alpha holds the specular intensity
+    void BeginGeometry(int width, int height)
+    {
+        resize(width, height);
+        glBindFramebuffer(GL_FRAMEBUFFER, gBufferFBO);
+        renderState().DepthMask(true);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        renderState().Disable(GL_BLEND);
+    }
+
+    // lights the G-buffer into framebuffer 0 and hands its depth over. Leaves framebuffer 0 bound, the depth
+    // test on and the scene's alpha blending back on
+    void Resolve(const vector<LightVolume> &lights, const glm::mat4 &view, const glm::mat4 &projection, int width, int height)
+    {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, gBufferFBO);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        glm::mat4 inverseViewProjection = glm::inverse(projection * view);
+        glm::vec2 screenSize((float)width, (float)height);
+        renderState().BindTexture(0, GL_TEXTURE_2D, albedoSpecular);
+        renderState().BindTexture(1, GL_TEXTURE_2D, normals);
+        renderState().BindTexture(2, GL_TEXTURE_2D, depth);
+
+        // the directional light covers every drawn pixel, and writes them whole
+        renderState().Disable(GL_DEPTH_TEST);
+        renderState().Disable(GL_BLEND);
+        renderState().DepthMask(false);
+        directionalShader.use();
+        directionalShader.setMat4(directionalInverseUniform, inverseViewProjection);
+        directionalShader.setVec2(directionalScreenUniform, screenSize);
+        renderState().BindVertexArray(emptyVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+
+        // the back faces of a volume pass GL_GEQUAL where a surface lies in front of them, which is every surface
+        // within the sphere and those in front of it, the shader drops the latter. Depth clamping keeps volumes
+        // reaching past the far plane whole, and the camera may stand inside one
+        if (!lights.empty())
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, lightVBO);
+            glBufferData(GL_ARRAY_BUFFER, lights.size() * sizeof(LightVolume), lights.data(), GL_STREAM_DRAW);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            renderState().Enable(GL_DEPTH_TEST);
+            renderState().DepthFunc(GL_GEQUAL);
+            renderState().Enable(GL_CULL_FACE);
+            renderState().CullFace(GL_FRONT);
+            renderState().Enable(GL_DEPTH_CLAMP);
+            renderState().Enable(GL_BLEND);
+            renderState().BlendFunc(GL_ONE, GL_ONE);
+            volumeShader.use();
+            volumeShader.setMat4(volumeInverseUniform, inverseViewProjection);
+            volumeShader.setVec2(volumeScreenUniform, screenSize);
+            renderState().BindVertexArray(sphereVAO);
+            glDrawElementsInstanced(GL_TRIANGLES, sphereIndexCount, GL_UNSIGNED_SHORT, 0, (GLsizei)lights.size());
+            renderState().CullFace(GL_BACK);
+            renderState().Disable(GL_DEPTH_CLAMP);
+            renderState().Disable(GL_CULL_FACE);
+        }
+
+        renderState().Enable(GL_DEPTH_TEST);
+        renderState().DepthFunc(GL_LESS);
+        renderState().DepthMask(true);
+        renderState().Enable(GL_BLEND);
+        renderState().BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    }
+
+    // deletes the targets, buffers and framebuffer, called at shutdown while the context still exists
+    void Release()
+    {
+        deleteTargets();
+        glDeleteFramebuffers(1, &gBufferFBO);
+        glDeleteVertexArrays(1, &emptyVAO);
+        glDeleteVertexArrays(1, &sphereVAO);
+        glDeleteBuffers(1, &sphereVBO);
+        glDeleteBuffers(1, &sphereEBO);
+        glDeleteBuffers(1, &lightVBO);
+        gBufferFBO = emptyVAO = sphereVAO = sphereVBO = sphereEBO = lightVBO = 0;
+        renderState().Invalidate();
+    }
+
+private:
+    // the sphere's subdivision, latitude bands and segments around
+    static const int SPHERE_RINGS = 8, SPHERE_SEGMENTS = 12;
+
+    Shader &directionalShader;
+    Shader &volumeShader;
+    Uniform directionalInverseUniform, directionalScreenUniform, volumeInverseUniform, volumeScreenUniform;
+
+    unsigned int gBufferFBO = 0, albedoSpecular = 0, normals = 0, depth = 0;
+    glm::ivec2 size = glm::ivec2(0, 0);
+    unsigned int emptyVAO = 0, sphereVAO = 0, sphereVBO = 0, sphereEBO = 0, lightVBO = 0;
+    GLsizei sphereIndexCount = 0;
+
+    void deleteTargets()
+    {
+        for (unsigned int *texture : {&albedoSpecular, &normals, &depth})
+        {
+            if (!*texture)
+                continue;
+            renderState().ForgetTexture(*texture);
+            glDeleteTextures(1, texture);
+            *texture = 0;
+        }
+    }
+
+    static unsigned int createTarget(GLint internalFormat, GLenum format, GLenum type, int width, int height)
+    {
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        renderState().BindTexture(0, GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        return texture;
+    }
+
+    // (re)allocates the targets for a new framebuffer size. The depth is 24 bits with stencil like the default
+    // framebuffer's, the depth blit in Resolve needs the formats to match
+    void resize(int width, int height)
+    {
+        if (size == glm::ivec2(width, height))
+            return;
+        size = glm::ivec2(width, height);
+        deleteTargets();
+        albedoSpecular = createTarget(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, width, height);
+        normals = createTarget(GL_RG16, GL_RG, GL_UNSIGNED_SHORT, width, height);
+        depth = createTarget(GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, width, height);
+        glBindFramebuffer(GL_FRAMEBUFFER, gBufferFBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, albedoSpecular, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normals, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depth, 0);
+        const GLenum attachments[2] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+        glDrawBuffers(2, attachments);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            cout << "ERROR::DEFERRED::G-buffer framebuffer is not complete" << endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // a unit sphere made of latitude bands, pushed out so its flat faces still enclose the round one
+    void createSphere()
+    {
+        const float pi = 3.14159265f;
+        float scale = 1.0f / (cos(pi / SPHERE_RINGS) * cos(pi / SPHERE_SEGMENTS));
+        vector<glm::vec3> positions;
+        for (int ring = 0; ring <= SPHERE_RINGS; ring++)
+        {
+            float latitude = pi * ring / SPHERE_RINGS;
+            for (int segment = 0; segment <= SPHERE_SEGMENTS; segment++)
+            {
+                float longitude = 2.0f * pi * segment / SPHERE_SEGMENTS;
+                positions.push_back(scale * glm::vec3(sin(latitude) * cos(longitude), cos(latitude), sin(latitude) * sin(longitude)));
+            }
+        }
+        // counter-clockwise from outside
+        vector<unsigned short> indices;
+        for (int ring = 0; ring < SPHERE_RINGS; ring++)
+            for (int segment = 0; segment < SPHERE_SEGMENTS; segment++)
+            {
+                unsigned short a = (unsigned short)(ring * (SPHERE_SEGMENTS + 1) + segment);
+                unsigned short b = (unsigned short)(a + SPHERE_SEGMENTS + 1);
+                if (ring > 0)
+                    indices.insert(indices.end(), {a, (unsigned short)(a + 1), b});
+                if (ring < SPHERE_RINGS - 1)
+                    indices.insert(indices.end(), {(unsigned short)(a + 1), (unsigned short)(b + 1), b});
+            }
+        sphereIndexCount = (GLsizei)indices.size();
+
+        glGenVertexArrays(1, &sphereVAO);
+        glGenBuffers(1, &sphereVBO);
+        glGenBuffers(1, &sphereEBO);
+        glGenBuffers(1, &lightVBO);
+        glBindVertexArray(sphereVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, sphereVBO);
+        glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec3), positions.data(), GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphereEBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned short), indices.data(), GL_STATIC_DRAW);
+
+        glBindBuffer(GL_ARRAY_BUFFER, lightVBO);
+        const size_t offsets[5] = {offsetof(LightVolume, position), offsetof(LightVolume, ambient), offsetof(LightVolume, diffuse),
+                                   offsetof(LightVolume, specular), offsetof(LightVolume, direction)};
+        for (unsigned int i = 0; i < 5; i++)
+        {
+            glEnableVertexAttribArray(1 + i);
+            glVertexAttribPointer(1 + i, 4, GL_FLOAT, GL_FALSE, sizeof(LightVolume), (void*)offsets[i]);
+            glVertexAttribDivisor(1 + i, 1);
+        }
+        glEnableVertexAttribArray(6);
+        glVertexAttribPointer(6, 1, GL_FLOAT, GL_FALSE, sizeof(LightVolume), (void*)offsetof(LightVolume, outerCutOff));
+        glVertexAttribDivisor(6, 1);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+};
+#endif
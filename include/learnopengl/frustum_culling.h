@@ -0,0 +1,135 @@
+#ifndef FRUSTUM_CULLING_H
+#define FRUSTUM_CULLING_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/mesh.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <initializer_list>
+#include <vector>
+
+// SSE is part of every x86-64 target, define FRUSTUM_CULLING_SCALAR to compare against the plain loop
+#if !defined(FRUSTUM_CULLING_SCALAR) && (defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1))
+#define FRUSTUM_CULLING_SSE
+#include <xmmintrin.h>
+#endif
+
+using namespace std;
+
+// the six planes of a view frustum with their normals pointing inwards,
+// a point p is inside a plane when dot(plane.xyz, p) + plane.w >= 0
+struct Frustum {
+    glm::vec4 planes[6];
+};
+
+// extracts the world space planes from projection * view (Gribb and Hartmann), the planes are normalized
+// so the distances they give are in world units
+inline Frustum extractFrustum(const glm::mat4 &viewProjection)
+{
+    glm::vec4 rows[4];
+    for (int i = 0; i < 4; i++)
+        rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+    Frustum frustum;
+    frustum.planes[0] = rows[3] + rows[0];   // left
+    frustum.planes[1] = rows[3] - rows[0];   // right
+    frustum.planes[2] = rows[3] + rows[1];   // bottom
+    frustum.planes[3] = rows[3] - rows[1];   // top
+    frustum.planes[4] = rows[3] + rows[2];   // near
+    frustum.planes[5] = rows[3] - rows[2];   // far
+    for (glm::vec4 &plane : frustum.planes)
+        plane /= glm::length(glm::vec3(plane));
+    return frustum;
+}
+
+// axis aligned box in world space
+struct Aabb {
+    glm::vec3 min;
+    glm::vec3 max;
+};
+
+// the world box enclosing model space bounds under a transform, from the box's center and the absolute
+// matrix applied to its half extents (Arvo)
+inline Aabb worldBox(const MeshBounds &bounds, const glm::mat4 &model)
+{
+    glm::vec3 localCenter = (bounds.min + bounds.max) * 0.5f;
+    glm::vec3 localExtent = (bounds.max - bounds.min) * 0.5f;
+    glm::vec3 center = glm::vec3(model * glm::vec4(localCenter, 1.0f));
+    glm::vec3 extent;
+    for (int i = 0; i < 3; i++)
+        extent[i] = fabs(model[0][i]) * localExtent.x + fabs(model[1][i]) * localExtent.y + fabs(model[2][i]) * localExtent.z;
+    return {center - extent, center + extent};
+}
+
+// World space boxes in a structure of arrays, as centers and half extents, tested against a frustum four at a time.
+// Every four consecutive entries from any index can be tested, the arrays carry three entries of padding at the end
+class BoxArrays
+{
+public:
+    void Resize(size_t count)
+    {
+        for (vector<float> *values : {&centerX, &centerY, &centerZ, &extentX, &extentY, &extentZ})
+            values->assign(count + 3, 0.0f);
+    }
+
+    void Set(size_t index, const Aabb &box)
+    {
+        glm::vec3 center = (box.min + box.max) * 0.5f, extent = (box.max - box.min) * 0.5f;
+        centerX[index] = center.x;
+        centerY[index] = center.y;
+        centerZ[index] = center.z;
+        extentX[index] = extent.x;
+        extentY[index] = extent.y;
+        extentZ[index] = extent.z;
+    }
+
+    // tests the boxes first to first + 3 against the frustum planes whose bits are set in planes, bit i of the
+    // result is set when box first + i is at least partly inside all of them
+    unsigned int Inside4(const Frustum &frustum, unsigned int planes, size_t first) const
+    {
+#ifdef FRUSTUM_CULLING_SSE
+        __m128 cx = _mm_loadu_ps(&centerX[first]), cy = _mm_loadu_ps(&centerY[first]), cz = _mm_loadu_ps(&centerZ[first]);
+        __m128 ex = _mm_loadu_ps(&extentX[first]), ey = _mm_loadu_ps(&extentY[first]), ez = _mm_loadu_ps(&extentZ[first]);
+        __m128 inside = _mm_cmpeq_ps(_mm_setzero_ps(), _mm_setzero_ps()); // all lanes set
+        for (int i = 0; i < 6; i++)
+        {
+            if (!(planes & (1u << i)))
+                continue;
+            const glm::vec4 &plane = frustum.planes[i];
+            __m128 nx = _mm_set1_ps(plane.x), ny = _mm_set1_ps(plane.y), nz = _mm_set1_ps(plane.z), d = _mm_set1_ps(plane.w);
+            // the box reaches |n| . extent towards the plane from its center
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)), _mm_add_ps(_mm_mul_ps(nz, cz), d));
+            __m128 reach = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(fabs(plane.x)), ex), _mm_mul_ps(_mm_set1_ps(fabs(plane.y)), ey)),
+                                      _mm_mul_ps(_mm_set1_ps(fabs(plane.z)), ez));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, reach), _mm_setzero_ps()));
+        }
+        return (unsigned int)_mm_movemask_ps(inside);
+#else
+        // what one SSE lane does
+        unsigned int mask = 0;
+        for (size_t lane = 0; lane < 4; lane++)
+        {
+            size_t b = first + lane;
+            bool inside = true;
+            for (int i = 0; i < 6; i++)
+            {
+                if (!(planes & (1u << i)))
+                    continue;
+                const glm::vec4 &plane = frustum.planes[i];
+                float distance = plane.x * centerX[b] + plane.y * centerY[b] + plane.z * centerZ[b] + plane.w;
+                float reach = fabs(plane.x) * extentX[b] + fabs(plane.y) * extentY[b] + fabs(plane.z) * extentZ[b];
+                inside = inside && distance + reach >= 0.0f;
+            }
+            mask |= inside ? 1u << lane : 0u;
+        }
+        return mask;
+#endif
+    }
+
+private:
+    vector<float> centerX, centerY, centerZ;
+    vector<float> extentX, extentY, extentZ;
+};
+#endif
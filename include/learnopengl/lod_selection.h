@@ -0,0 +1,88 @@
+#ifndef LOD_SELECTION_H
+#define LOD_SELECTION_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/mesh.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using namespace std;
+
+// Picks the level of detail of every drawn object from how large its simplification error shows on screen, and
+// cross-fades between levels with an ordered dither (see object_lighting.fs) so a switch never pops.
+const float LOD_FADE_SECONDS = 0.4f;   // how long a change of level takes
+const float LOD_HYSTERESIS = 0.75f;    // going to a coarser level needs the error this far below the limit
+
+// pixels one model space unit covers on screen at the point of the bounds nearest to the camera, fovY in radians.
+// The largest scale of the model matrix counts, objects the camera is inside of get an infinite size
+inline float lodPixelsPerUnit(const MeshBounds &bounds, const glm::mat4 &model, const glm::vec3 &cameraPosition,
+                              float fovY, float viewportHeight)
+{
+    glm::vec3 center = glm::vec3(model * glm::vec4(bounds.center, 1.0f));
+    float scale = max(glm::length(glm::vec3(model[0])), max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+    float distance = glm::length(center - cameraPosition) - bounds.radius * scale;
+    if (distance <= 0.0f)
+        return INFINITY;
+    return scale * viewportHeight / (2.0f * tan(fovY * 0.5f) * distance);
+}
+
+// the coarsest level whose error stays within maxPixelError on screen, errors as in Model::lodErrors
+inline unsigned int selectLod(const vector<float> &errors, float pixelsPerUnit, float maxPixelError, unsigned int current)
+{
+    unsigned int level = 0;
+    for (unsigned int candidate = 1; candidate < errors.size(); candidate++)
+    {
+        // levels past the current one only count when they stay clearly below the limit, so an object sitting
+        // at a threshold does not flip back and forth
+        float limit = candidate > current ? maxPixelError * LOD_HYSTERESIS : maxPixelError;
+        if (errors[candidate] * pixelsPerUnit > limit)
+            break;
+        level = candidate;
+    }
+    return level;
+}
+
+// the level of detail of one object over time. While next differs from level both are drawn, level with the
+// fade and next with its negation, until the fade reaches 1 and next takes over
+struct LodTransition {
+    unsigned int level = 0;
+    unsigned int next = 0;
+    float fade = 0.0f;
+    bool shown = false;   // drawn last frame, objects coming into view start at the wanted level without a fade
+
+    void Update(unsigned int wanted, float deltaTime)
+    {
+        if (!shown)
+        {
+            level = next = wanted;
+            fade = 0.0f;
+            shown = true;
+            return;
+        }
+        if (Fading())
+        {
+            fade += deltaTime / LOD_FADE_SECONDS;
+            if (fade >= 1.0f)
+            {
+                level = next;
+                fade = 0.0f;
+            }
+            return;
+        }
+        if (wanted != level)
+        {
+            // a fade of 0 would draw both levels whole
+            next = wanted;
+            fade = min(max(deltaTime / LOD_FADE_SECONDS, 1.0f / 64.0f), 1.0f - 1.0f / 64.0f);
+        }
+    }
+
+    // the object was not drawn this frame
+    void Hide() { shown = false; }
+
+    bool Fading() const { return next != level; }
+};
+#endif
@@ -5,9 +5,14 @@
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
 
+#include <learnopengl/render_state.h>
 #include <learnopengl/shader.h>
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
 #include <string>
 #include <vector>
 using namespace std;
@@ -25,81 +30,527 @@ struct Vertex {
     glm::vec3 Bitangent;
 };
 
+// GPU side vertex layout, chosen per model when it is imported
+enum class VertexFormat : uint32_t {
+    Full,   // Vertex as it is, 56 bytes
+    Packed  // PackedVertex, 24 bytes
+};
+
+// compact vertex for meshes where vertex fetch matters more than precision (large terrain meshes).
+// normal and tangent are signed normalized 10:10:10:2 with the bitangent sign in the tangent's w,
+// texture coordinates are half floats, which stay texel exact for coordinates roughly within [-4, 4].
+struct PackedVertex {
+    glm::vec3 Position;
+    uint32_t  Normal;       // GL_INT_2_10_10_10_REV
+    uint16_t  TexCoords[2]; // GL_HALF_FLOAT
+    uint32_t  Tangent;      // GL_INT_2_10_10_10_REV, w is +1 or -1
+};
+static_assert(sizeof(PackedVertex) == 24, "PackedVertex must stay tightly packed");
+
+inline size_t vertexStride(VertexFormat format)
+{
+    return format == VertexFormat::Packed ? sizeof(PackedVertex) : sizeof(Vertex);
+}
+
+inline PackedVertex packVertex(const Vertex &vertex)
+{
+    PackedVertex packed;
+    packed.Position = vertex.Position;
+    packed.Normal = glm::packSnorm3x10_1x2(glm::vec4(vertex.Normal, 0.0f));
+    packed.TexCoords[0] = glm::packHalf1x16(vertex.TexCoords.x);
+    packed.TexCoords[1] = glm::packHalf1x16(vertex.TexCoords.y);
+    // the bitangent is rebuilt as sign * cross(normal, tangent), so only its handedness is kept
+    float handedness = glm::dot(glm::cross(vertex.Normal, vertex.Tangent), vertex.Bitangent) < 0.0f ? -1.0f : 1.0f;
+    packed.Tangent = glm::packSnorm3x10_1x2(glm::vec4(vertex.Tangent, handedness));
+    return packed;
+}
+
+// the inverse of packVertex, up to the precision lost by packing
+inline Vertex unpackVertex(const PackedVertex &packed)
+{
+    Vertex vertex;
+    vertex.Position = packed.Position;
+    vertex.Normal = glm::vec3(glm::unpackSnorm3x10_1x2(packed.Normal));
+    vertex.TexCoords = glm::vec2(glm::unpackHalf1x16(packed.TexCoords[0]), glm::unpackHalf1x16(packed.TexCoords[1]));
+    glm::vec4 tangent = glm::unpackSnorm3x10_1x2(packed.Tangent);
+    vertex.Tangent = glm::vec3(tangent);
+    vertex.Bitangent = tangent.w * glm::cross(vertex.Normal, vertex.Tangent);
+    return vertex;
+}
+
+inline vector<PackedVertex> packVertices(const vector<Vertex> &vertices)
+{
+    vector<PackedVertex> packed(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++)
+        packed[i] = packVertex(vertices[i]);
+    return packed;
+}
 
 
+
+// what a texture is used for, the sampler it ends up in is named after it
+enum class TextureRole : uint8_t { Diffuse, Specular, Normal, Height, Other };
+
+inline TextureRole textureRole(const string &type)
+{
+    if (type == "texture_diffuse")
+        return TextureRole::Diffuse;
+    if (type == "texture_specular")
+        return TextureRole::Specular;
+    if (type == "texture_normal")
+        return TextureRole::Normal;
+    if (type == "texture_height")
+        return TextureRole::Height;
+    return TextureRole::Other;
+}
+
 struct Texture {
     unsigned int id;
     string type;
     string path;
+    TextureRole role = TextureRole::Other;
+};
+
+// part of a mesh drawn with one call. Its indices are relative to baseVertex, which lets meshes with more
+// vertices than 16 bit indices can address still use them
+struct DrawRange {
+    unsigned int firstIndex;
+    unsigned int indexCount;
+    int baseVertex;
+};
+
+// one level of detail of a mesh, drawn over the same vertices as the full mesh with indices of its own.
+// At import it is the index span [firstIndex, firstIndex + indexCount), once the indices are narrowed it is
+// drawn as the ranges [firstRange, firstRange + rangeCount). error is how far the simplification moved the
+// surface at most, in model space units; level 0 is the full mesh with error 0
+struct MeshLod {
+    unsigned int firstIndex;
+    unsigned int indexCount;
+    unsigned int firstRange;
+    unsigned int rangeCount;
+    float error;
 };
 
+// bounding volumes of a mesh in model space, an axis aligned box and a sphere around the box's center
+struct MeshBounds {
+    glm::vec3 min = glm::vec3(0.0f);
+    glm::vec3 max = glm::vec3(0.0f);
+    glm::vec3 center = glm::vec3(0.0f);
+    float radius = 0.0f;
+};
+
+// the box is exact, the sphere is centered on the box and reaches the farthest vertex
+inline MeshBounds computeBounds(const vector<Vertex> &vertices)
+{
+    MeshBounds bounds;
+    if (vertices.empty())
+        return bounds;
+    bounds.min = bounds.max = vertices.front().Position;
+    for (const Vertex &vertex : vertices)
+    {
+        bounds.min = glm::min(bounds.min, vertex.Position);
+        bounds.max = glm::max(bounds.max, vertex.Position);
+    }
+    bounds.center = (bounds.min + bounds.max) * 0.5f;
+    float radiusSquared = 0.0f;
+    for (const Vertex &vertex : vertices)
+    {
+        glm::vec3 offset = vertex.Position - bounds.center;
+        radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+    }
+    bounds.radius = sqrt(radiusSquared);
+    return bounds;
+}
+
+// bounds enclosing both, the sphere is the smallest one around the two spheres
+inline MeshBounds mergeBounds(const MeshBounds &a, const MeshBounds &b)
+{
+    MeshBounds bounds;
+    bounds.min = glm::min(a.min, b.min);
+    bounds.max = glm::max(a.max, b.max);
+    float distance = glm::length(b.center - a.center);
+    if (distance + b.radius <= a.radius)
+    {
+        bounds.center = a.center;
+        bounds.radius = a.radius;
+    }
+    else if (distance + a.radius <= b.radius)
+    {
+        bounds.center = b.center;
+        bounds.radius = b.radius;
+    }
+    else
+    {
+        bounds.radius = (distance + a.radius + b.radius) * 0.5f;
+        bounds.center = a.center + (b.center - a.center) * ((bounds.radius - a.radius) / distance);
+    }
+    return bounds;
+}
+
+// CPU side result of importing a mesh, it becomes a Mesh once uploaded on the GL thread
+struct MeshData {
+    vector<Vertex>       vertices;
+    vector<unsigned int> indices;
+    vector<Texture>      textures; // only type and path are known, ids are resolved on upload
+    vector<PackedVertex> packedVertices; // vertices in the packed layout, filled when the model is imported packed
+    vector<uint16_t>     shortIndices;   // 16 bit copy of indices used for upload when the mesh allows it
+    vector<DrawRange>    ranges;         // empty means a single range over the 32 bit indices
+    MeshBounds           bounds;
+    vector<MeshLod>      lods;           // empty without simplified levels, the indices hold all levels back to back
+};
+
+inline size_t indexSize(GLenum indexType)
+{
+    return indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(unsigned int);
+}
+
+// everything Mesh uploads, pointing into data owned by a MeshData or a mapped mesh cache
+struct MeshBuffers {
+    VertexFormat vertexFormat;
+    const void *vertices;
+    unsigned int vertexCount;
+    const void *indices;
+    unsigned int indexCount;
+    GLenum indexType; // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+    vector<DrawRange> ranges;
+    MeshBounds bounds;
+    vector<MeshLod> lods;
+};
+
+inline MeshBuffers meshBuffers(const MeshData &data, VertexFormat format)
+{
+    MeshBuffers buffers;
+    buffers.vertexFormat = format;
+    if (format == VertexFormat::Packed)
+        buffers.vertices = data.packedVertices.data();
+    else
+        buffers.vertices = data.vertices.data();
+    buffers.vertexCount = (unsigned int)data.vertices.size();
+    buffers.indexCount = (unsigned int)data.indices.size();
+    if (!data.shortIndices.empty())
+    {
+        buffers.indices = data.shortIndices.data();
+        buffers.indexType = GL_UNSIGNED_SHORT;
+    }
+    else
+    {
+        buffers.indices = data.indices.data();
+        buffers.indexType = GL_UNSIGNED_INT;
+    }
+    buffers.ranges = data.ranges;
+    buffers.bounds = data.bounds;
+    buffers.lods = data.lods;
+    if (buffers.ranges.empty())
+        buffers.ranges.push_back({0, buffers.indexCount, 0});
+    return buffers;
+}
+
+// sets the attribute pointers of the bound VAO for vertices of the given format in the bound GL_ARRAY_BUFFER.
+// the packed layout uses the same attribute locations, its normalized formats make the shaders see plain floats.
+// it has no bitangent attribute, shaders that need one compute it as aTangent.w * cross(aNormal, aTangent.xyz)
+inline void setupVertexAttributes(VertexFormat format)
+{
+    if (format == VertexFormat::Packed)
+    {
+        // vertex Positions
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)0);
+        // vertex normals
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Normal));
+        // vertex texture coords
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, TexCoords));
+        // vertex tangent, w holds the bitangent sign
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Tangent));
+        return;
+    }
+
+    // vertex Positions
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+    // vertex normals
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+    // vertex texture coords
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+    // vertex tangent
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
+    // vertex bitangent
+    glEnableVertexAttribArray(4);
+    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+}
+
+// model matrix of an object together with its normal matrix, transpose(inverse(mat3(model))),
+// computed once on the CPU so the shaders don't invert a matrix per vertex
+struct WorldTransform {
+    glm::mat4 model = glm::mat4(1.0f);
+    glm::mat3 normal = glm::mat3(1.0f);
+};
+
+// first of the attribute locations a per-instance WorldTransform occupies, one per column:
+// four for the model matrix followed by three for the normal matrix
+#define INSTANCE_MATRIX_ATTRIBUTE 5
+#define INSTANCE_NORMAL_ATTRIBUTE 9
+// location of the per-instance level of detail fade, one float per instance (see Model::DrawInstanced)
+#define INSTANCE_FADE_ATTRIBUTE 12
+
+// sets the attribute pointers of the bound VAO for one WorldTransform per instance in the bound GL_ARRAY_BUFFER
+inline void setupInstanceAttributes()
+{
+    for (unsigned int column = 0; column < 4; column++)
+    {
+        GLuint location = INSTANCE_MATRIX_ATTRIBUTE + column;
+        glEnableVertexAttribArray(location);
+        glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(WorldTransform),
+                              (void*)(offsetof(WorldTransform, model) + column * sizeof(glm::vec4)));
+        glVertexAttribDivisor(location, 1);
+    }
+    for (unsigned int column = 0; column < 3; column++)
+    {
+        GLuint location = INSTANCE_NORMAL_ATTRIBUTE + column;
+        glEnableVertexAttribArray(location);
+        glVertexAttribPointer(location, 3, GL_FLOAT, GL_FALSE, sizeof(WorldTransform),
+                              (void*)(offsetof(WorldTransform, normal) + column * sizeof(glm::vec3)));
+        glVertexAttribDivisor(location, 1);
+    }
+}
+
+// sets the attribute pointer of the bound VAO for one fade per instance in the bound GL_ARRAY_BUFFER
+inline void setupInstanceFadeAttribute()
+{
+    glEnableVertexAttribArray(INSTANCE_FADE_ATTRIBUTE);
+    glVertexAttribPointer(INSTANCE_FADE_ATTRIBUTE, 1, GL_FLOAT, GL_FALSE, sizeof(float), (void*)0);
+    glVertexAttribDivisor(INSTANCE_FADE_ATTRIBUTE, 1);
+}
+
+// Without a shared buffer a mesh owns its VAO, VBO and EBO. Models put all their meshes into one set of
+// buffers instead, a mesh is then just a slice of them drawn with base vertex draws.
 class Mesh {
 public:
-    // mesh Data
+    // mesh Data. vertices and indices are only kept on the CPU for meshes that ask for it (picking, collision),
+    // everyone else drops them once they are uploaded. Only the full level's indices are kept
     vector<Vertex>       vertices;
     vector<unsigned int> indices;
     vector<Texture>      textures;
 
     unsigned int VAO;
+    unsigned int indexCount;
+    VertexFormat vertexFormat = VertexFormat::Full;
+    GLenum indexType = GL_UNSIGNED_INT;
+    vector<DrawRange> ranges;
+    // model space bounds, computed at import and kept even when the vertices are dropped
+    MeshBounds bounds;
+    // the simplified levels, empty when the mesh only has its full one
+    vector<MeshLod> lods;
+    // where the mesh starts in its buffers: the byte offset of its first index and the vertex its indices count from
+    size_t indexByteOffset = 0;
+    int vertexOffset = 0;
     std::string glslIdentifierPrefix;
-    // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    // constructor, takes over the given data (pass it with std::move to avoid copies) and
+    // frees the vertices and indices after uploading them unless retainCpuData is set
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, bool retainCpuData = false)
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
+        this->vertices = std::move(vertices);
+        this->indices = std::move(indices);
+        this->textures = std::move(textures);
+        this->ranges.push_back({0, (unsigned int)this->indices.size(), 0});
+        this->bounds = computeBounds(this->vertices);
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
-        setupMesh();
+        setupMesh(this->vertices.data(), this->vertices.size(), this->indices.data(), this->indices.size());
+        if (!retainCpuData)
+            ReleaseCpuData();
     }
 
-    // render the mesh
-    void Draw(Shader &shader)
+    // constructor for data that is already laid out for the GPU (e.g. a memory mapped mesh cache),
+    // uploads straight from the given buffers. With retainCpuData the vertices and indices are
+    // copied back into full precision vectors, otherwise the mesh keeps nothing on the CPU.
+    Mesh(const MeshBuffers &buffers, vector<Texture> textures, bool retainCpuData = false)
     {
-        // bind appropriate textures
-        unsigned int diffuseNr  = 1;
-        unsigned int specularNr = 1;
-        unsigned int normalNr   = 1;
-        unsigned int heightNr   = 1;
-        for(unsigned int i = 0; i < textures.size(); i++)
+        this->textures = std::move(textures);
+        this->vertexFormat = buffers.vertexFormat;
+        this->indexType = buffers.indexType;
+        this->ranges = buffers.ranges;
+        this->bounds = buffers.bounds;
+        this->lods = buffers.lods;
+        setupMesh(buffers.vertices, buffers.vertexCount, buffers.indices, buffers.indexCount);
+        if (retainCpuData)
+            copyCpuData(buffers);
+    }
+
+    // constructor for a mesh whose data the owner of sharedVAO has already uploaded into its buffers,
+    // at indexByteOffset in the element buffer and vertexOffset in the vertex buffer
+    Mesh(const MeshBuffers &buffers, vector<Texture> textures, unsigned int sharedVAO, size_t indexByteOffset, int vertexOffset,
+         bool retainCpuData = false)
+    {
+        this->textures = std::move(textures);
+        this->vertexFormat = buffers.vertexFormat;
+        this->indexType = buffers.indexType;
+        this->ranges = buffers.ranges;
+        this->bounds = buffers.bounds;
+        this->lods = buffers.lods;
+        this->indexCount = buffers.indexCount;
+        this->VAO = sharedVAO;
+        this->VBO = this->EBO = 0;
+        this->indexByteOffset = indexByteOffset;
+        this->vertexOffset = vertexOffset;
+        if (retainCpuData)
+            copyCpuData(buffers);
+    }
+
+    // frees the CPU copies of the vertices and indices, the GPU buffers are unaffected
+    void ReleaseCpuData()
+    {
+        vector<Vertex>().swap(vertices);
+        vector<unsigned int>().swap(indices);
+    }
+
+    // memory the mesh holds on the CPU
+    size_t CpuBytes() const
+    {
+        size_t bytes = sizeof(Mesh) + vertices.capacity() * sizeof(Vertex) + indices.capacity() * sizeof(unsigned int)
+                       + textures.capacity() * sizeof(Texture) + ranges.capacity() * sizeof(DrawRange)
+                       + lods.capacity() * sizeof(MeshLod);
+        for (const Texture &texture : textures)
+            bytes += texture.type.capacity() + texture.path.capacity();
+        return bytes + glslIdentifierPrefix.capacity() + samplerLocations.capacity() * sizeof(GLint);
+    }
+
+    // resolves the sampler uniform of every texture in the given program, texture i is bound to unit i.
+    // Samplers are named prefix + type + N, N counting the textures of each role from 1 (texture_diffuse1, ...).
+    // All the string work happens here, once per shader and mesh, drawing just uses the stored locations
+    void BindShader(const Shader &shader)
+    {
+        unsigned int roleNumbers[(int)TextureRole::Other] = {1, 1, 1, 1};
+        samplerLocations.resize(textures.size());
+        for (unsigned int i = 0; i < textures.size(); i++)
         {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-            // retrieve texture number (the N in diffuse_textureN)
-            string number;
-            string name = textures[i].type;
-            if(name == "texture_diffuse")
-                number = std::to_string(diffuseNr++);
-            else if(name == "texture_specular")
-                number = std::to_string(specularNr++); // transfer unsigned int to stream
-            else if(name == "texture_normal")
-                number = std::to_string(normalNr++); // transfer unsigned int to stream
-            else if(name == "texture_height")
-                number = std::to_string(heightNr++); // transfer unsigned int to stream
-
-            // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (glslIdentifierPrefix + name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            string name = glslIdentifierPrefix + textures[i].type;
+            if (textures[i].role != TextureRole::Other)
+                name += std::to_string(roleNumbers[(int)textures[i].role]++);
+            samplerLocations[i] = shader.location(name);
         }
+        samplerProgram = shader.ID;
+    }
 
+    void SetShaderTextureNamePrefix(const std::string &prefix)
+    {
+        glslIdentifierPrefix = prefix;
+        samplerProgram = 0;
+    }
 
+    // render the mesh
+    void Draw(Shader &shader)
+    {
+        renderState().BindVertexArray(VAO);
+        DrawElements(shader);
+    }
 
-        // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
+    // binds the textures and draws the given level of detail, expects the mesh's VAO to be bound already.
+    // Levels past the mesh's last one draw the last one
+    void DrawElements(Shader &shader, unsigned int lod = 0)
+    {
+        bindTextures(shader);
+        drawRanges(0, lod);
+    }
+
+    // draws instanceCount instances in one call per range, the VAO must carry the instance attributes
+    // (see setupInstanceAttributes) and be bound already
+    void DrawElementsInstanced(Shader &shader, unsigned int instanceCount, unsigned int lod = 0)
+    {
+        bindTextures(shader);
+        drawRanges(instanceCount, lod);
+    }
 
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
+    // triangles drawn at a level of detail
+    unsigned int TriangleCount(unsigned int lod = 0) const
+    {
+        if (lods.empty())
+            return indexCount / 3;
+        return lods[std::min(lod, (unsigned int)lods.size() - 1)].indexCount / 3;
     }
 
 private:
-    // render data
+    // render data, both 0 when the buffers are shared
     unsigned int VBO, EBO;
+    // sampler uniform location per texture unit in the program samplerProgram, filled by BindShader
+    vector<GLint> samplerLocations;
+    GLuint samplerProgram = 0;
+
+    void bindTextures(Shader &shader)
+    {
+        // only the first draw with a new shader resolves the samplers
+        if (samplerProgram != shader.ID)
+            BindShader(shader);
+
+        // bind appropriate textures
+        for(unsigned int i = 0; i < textures.size(); i++)
+        {
+            // point the sampler at the unit, samplers the shader does not have are skipped
+            if (samplerLocations[i] >= 0)
+                glUniform1i(samplerLocations[i], i);
+            // and bind the texture, the state tracker skips it when it is still bound from the last mesh
+            renderState().BindTexture(i, GL_TEXTURE_2D, textures[i].id);
+        }
+
+    }
+
+    // draws every range of a level, instanced when instanceCount is not 0
+    void drawRanges(unsigned int instanceCount, unsigned int lod)
+    {
+        size_t first = 0, count = ranges.size();
+        if (!lods.empty())
+        {
+            const MeshLod &level = lods[std::min(lod, (unsigned int)lods.size() - 1)];
+            first = level.firstRange;
+            count = level.rangeCount;
+        }
+        for (size_t i = first; i < first + count; i++)
+        {
+            const DrawRange &range = ranges[i];
+            void *offset = (void*)(indexByteOffset + range.firstIndex * indexSize(indexType));
+            int baseVertex = vertexOffset + range.baseVertex;
+            if (instanceCount > 0)
+                glDrawElementsInstancedBaseVertex(GL_TRIANGLES, range.indexCount, indexType, offset, instanceCount, baseVertex);
+            else if (baseVertex == 0)
+                glDrawElements(GL_TRIANGLES, range.indexCount, indexType, offset);
+            else
+                glDrawElementsBaseVertex(GL_TRIANGLES, range.indexCount, indexType, offset, baseVertex);
+        }
+    }
+
+    void copyCpuData(const MeshBuffers &buffers)
+    {
+        vertices.resize(buffers.vertexCount);
+        for (unsigned int i = 0; i < buffers.vertexCount; i++)
+        {
+            if (buffers.vertexFormat == VertexFormat::Packed)
+                vertices[i] = unpackVertex(((const PackedVertex*)buffers.vertices)[i]);
+            else
+                vertices[i] = ((const Vertex*)buffers.vertices)[i];
+        }
+        // the ranges are rebased, so the indices come back as absolute 32 bit ones
+        indices.resize(buffers.indexCount);
+        for (const DrawRange &range : buffers.ranges)
+            for (unsigned int i = range.firstIndex; i < range.firstIndex + range.indexCount; i++)
+            {
+                unsigned int index = buffers.indexType == GL_UNSIGNED_SHORT ? ((const uint16_t*)buffers.indices)[i]
+                                                                            : ((const unsigned int*)buffers.indices)[i];
+                indices[i] = index + range.baseVertex;
+            }
+        if (!lods.empty())
+            indices.resize(lods[0].indexCount);
+    }
 
     // initializes all the buffer objects/arrays
-    void setupMesh()
+    void setupMesh(const void *vertexData, size_t vertexCount, const void *indexData, size_t indexCount)
     {
+        this->indexCount = (unsigned int)indexCount;
+
         // create buffers/arrays
         glGenVertexArrays(1, &VAO);
         glGenBuffers(1, &VBO);
@@ -111,29 +562,15 @@ private:
         // A great thing about structs is that their memory layout is sequential for all its items.
         // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
         // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+        glBufferData(GL_ARRAY_BUFFER, vertexCount * vertexStride(vertexFormat), vertexData, GL_STATIC_DRAW);
 
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * indexSize(indexType), indexData, GL_STATIC_DRAW);
 
         // set the vertex attribute pointers
-        // vertex Positions
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-        // vertex normals
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-        // vertex texture coords
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-        // vertex tangent
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-        // vertex bitangent
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+        setupVertexAttributes(vertexFormat);
 
         glBindVertexArray(0);
     }
 };
-#endif
\ No newline at end of file
+#endif
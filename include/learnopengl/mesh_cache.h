@@ -0,0 +1,524 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <learnopengl/mesh.h>
+#include <learnopengl/mesh_optimizer.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// Binary mesh cache written next to every imported model file (<model>.meshcache).
+// Layout (all offsets are from the start of the file, every block is 8 byte aligned):
+//   MeshCacheHeader
+//   MeshCacheEntry[meshCount]
+//   per mesh: Vertex or PackedVertex[vertexCount], 16 or 32 bit indices[indexCount], texture table, DrawRange[rangeCount],
+//             MeshLod[lodCount]
+// The texture table is a list of null terminated "type\0path\0" pairs, resolved to GL textures on load.
+// The vertex block has exactly the layout Mesh::setupMesh uploads, so a mapped cache goes into glBufferData as is.
+const char MESH_CACHE_MAGIC[4] = {'R', 'G', 'M', 'C'};
+const uint32_t MESH_CACHE_VERSION = 7;
+
+struct MeshCacheHeader {
+    char     magic[4];
+    uint32_t version;
+    uint32_t vertexSize;    // size of a vertex at the time of writing, guards against layout changes
+    uint32_t meshCount;
+    uint32_t vertexFormat;  // VertexFormat of the vertex blocks, a cache only serves models imported with the same format
+    uint32_t lodLevels;     // the levels of detail asked for at import, a model asking for others imports again
+    uint64_t sourceSize;
+    int64_t  sourceMtime;
+    uint64_t sourceHash;
+    double   importMillis;  // how long the Assimp import took when the cache was written
+};
+
+struct MeshCacheEntry {
+    uint64_t vertexOffset;
+    uint64_t indexOffset;
+    uint64_t textureOffset;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t textureCount;
+    uint32_t textureBytes;
+    uint64_t rangeOffset;
+    uint32_t rangeCount;
+    uint32_t indexSize;     // 2 or 4 bytes
+    MeshBounds bounds;      // so a warm start needs no pass over the vertices
+    uint64_t lodOffset;
+    uint32_t lodCount;      // 0 for meshes without simplified levels
+    uint32_t reserved;
+};
+
+// read-only view of a whole file, memory mapped where the platform allows it
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    ~MappedFile() { close(); }
+
+    bool open(const string &path)
+    {
+        close();
+#ifndef _WIN32
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size <= 0)
+        {
+            ::close(fd);
+            return false;
+        }
+        void *mapped = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd); // the mapping keeps its own reference to the file
+        if (mapped == MAP_FAILED)
+            return false;
+        bytes = (const unsigned char*)mapped;
+        length = (size_t)st.st_size;
+#else
+        ifstream in(path, ios::binary | ios::ate);
+        if (!in)
+            return false;
+        buffer.resize((size_t)in.tellg());
+        in.seekg(0);
+        in.read((char*)buffer.data(), buffer.size());
+        if (!in || buffer.empty())
+        {
+            buffer.clear();
+            return false;
+        }
+        bytes = buffer.data();
+        length = buffer.size();
+#endif
+        return true;
+    }
+
+    void close()
+    {
+#ifndef _WIN32
+        if (bytes)
+            munmap((void*)bytes, length);
+#else
+        buffer.clear();
+#endif
+        bytes = nullptr;
+        length = 0;
+    }
+
+    const unsigned char *data() const { return bytes; }
+    size_t size() const { return length; }
+    bool isOpen() const { return bytes != nullptr; }
+
+private:
+    const unsigned char *bytes = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    vector<unsigned char> buffer;
+#endif
+};
+
+struct SourceStamp {
+    uint64_t size = 0;
+    int64_t mtime = 0;
+};
+
+inline bool statSource(const string &path, SourceStamp &stamp)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
+        return false;
+    stamp.size = (uint64_t)st.st_size;
+    stamp.mtime = (int64_t)st.st_mtime;
+    return true;
+}
+
+// 64-bit FNV-1a, only used to tell whether a touched source file actually changed
+inline uint64_t hashBytes(const unsigned char *data, size_t size)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+inline bool hashFile(const string &path, uint64_t &hash)
+{
+    MappedFile source;
+    if (!source.open(path))
+        return false;
+    hash = hashBytes(source.data(), source.size());
+    return true;
+}
+
+class MeshCache
+{
+public:
+    static string pathFor(const string &sourcePath)
+    {
+        return sourcePath + ".meshcache";
+    }
+
+    // maps the cache belonging to sourcePath, fails if it is missing, corrupt, written by another
+    // format version, vertex format or levels of detail or if the source file has changed since the cache was written
+    bool open(const string &sourcePath, VertexFormat format = VertexFormat::Full, unsigned int lodLevels = 1)
+    {
+        SourceStamp stamp;
+        if (!statSource(sourcePath, stamp) || !file.open(pathFor(sourcePath)))
+            return false;
+        if (!validate(format, lodLevels))
+        {
+            file.close();
+            return false;
+        }
+        if (header->sourceSize != stamp.size || header->sourceMtime != stamp.mtime)
+        {
+            // the file was touched, only rebuild if its contents are really different
+            uint64_t hash;
+            if (header->sourceSize != stamp.size || !hashFile(sourcePath, hash) || hash != header->sourceHash)
+            {
+                file.close();
+                return false;
+            }
+            refreshStamp(sourcePath, stamp);
+        }
+        return true;
+    }
+
+    unsigned int meshCount() const { return header->meshCount; }
+    double importMillis() const { return header->importMillis; }
+    VertexFormat vertexFormat() const { return (VertexFormat)header->vertexFormat; }
+
+    // Vertex or PackedVertex elements, see vertexFormat
+    const void *vertices(unsigned int mesh) const
+    {
+        return file.data() + entries[mesh].vertexOffset;
+    }
+    unsigned int vertexCount(unsigned int mesh) const { return entries[mesh].vertexCount; }
+
+    // 16 or 32 bit, see indexType
+    const void *indices(unsigned int mesh) const
+    {
+        return file.data() + entries[mesh].indexOffset;
+    }
+    unsigned int indexCount(unsigned int mesh) const { return entries[mesh].indexCount; }
+    GLenum indexType(unsigned int mesh) const { return entries[mesh].indexSize == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT; }
+
+    vector<DrawRange> ranges(unsigned int mesh) const
+    {
+        const DrawRange *first = (const DrawRange*)(file.data() + entries[mesh].rangeOffset);
+        return vector<DrawRange>(first, first + entries[mesh].rangeCount);
+    }
+
+    vector<MeshLod> lods(unsigned int mesh) const
+    {
+        const MeshLod *first = (const MeshLod*)(file.data() + entries[mesh].lodOffset);
+        return vector<MeshLod>(first, first + entries[mesh].lodCount);
+    }
+
+    // the mapped data of a mesh, ready to be handed to Mesh
+    MeshBuffers buffers(unsigned int mesh) const
+    {
+        return {vertexFormat(), vertices(mesh), vertexCount(mesh), indices(mesh), indexCount(mesh), indexType(mesh), ranges(mesh),
+                entries[mesh].bounds, lods(mesh)};
+    }
+
+    // texture references of the mesh, the ids are left for the caller to resolve
+    vector<Texture> textures(unsigned int mesh) const
+    {
+        vector<Texture> result;
+        const char *cursor = (const char*)(file.data() + entries[mesh].textureOffset);
+        const char *end = cursor + entries[mesh].textureBytes;
+        for (unsigned int i = 0; i < entries[mesh].textureCount && cursor < end; i++)
+        {
+            Texture texture;
+            texture.id = 0;
+            texture.type = cursor;
+            cursor += texture.type.size() + 1;
+            if (cursor >= end)
+                break;
+            texture.path = cursor;
+            cursor += texture.path.size() + 1;
+            result.push_back(texture);
+        }
+        return result;
+    }
+
+    // writes the cache for sourcePath through a temporary file, so a crash never leaves a half written cache behind.
+    // the vertex blocks are taken from MeshData::packedVertices for the packed format, and the 16 bit indices
+    // are stored instead of the 32 bit ones wherever a mesh has them
+    static bool write(const string &sourcePath, const vector<MeshData> &meshes, VertexFormat format, unsigned int lodLevels,
+                      double importMillis)
+    {
+        MeshCacheHeader header;
+        memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic));
+        header.version = MESH_CACHE_VERSION;
+        header.vertexSize = (uint32_t)vertexStride(format);
+        header.meshCount = (uint32_t)meshes.size();
+        header.vertexFormat = (uint32_t)format;
+        header.lodLevels = lodLevels;
+        header.importMillis = importMillis;
+        SourceStamp stamp;
+        if (!statSource(sourcePath, stamp) || !hashFile(sourcePath, header.sourceHash))
+            return false;
+        header.sourceSize = stamp.size;
+        header.sourceMtime = stamp.mtime;
+
+        vector<MeshCacheEntry> entries(meshes.size());
+        vector<string> textureTables(meshes.size());
+        vector<MeshBuffers> buffers;
+        for (const MeshData &mesh : meshes)
+            buffers.push_back(meshBuffers(mesh, format));
+        uint64_t offset = align(sizeof(MeshCacheHeader) + entries.size() * sizeof(MeshCacheEntry));
+        for (size_t i = 0; i < meshes.size(); i++)
+        {
+            const MeshData &mesh = meshes[i];
+            for (const Texture &texture : mesh.textures)
+            {
+                textureTables[i] += texture.type;
+                textureTables[i] += '\0';
+                textureTables[i] += texture.path;
+                textureTables[i] += '\0';
+            }
+            MeshCacheEntry &entry = entries[i];
+            entry.vertexCount = (uint32_t)mesh.vertices.size();
+            entry.indexCount = (uint32_t)mesh.indices.size();
+            entry.textureCount = (uint32_t)mesh.textures.size();
+            entry.textureBytes = (uint32_t)textureTables[i].size();
+            entry.rangeCount = (uint32_t)buffers[i].ranges.size();
+            entry.indexSize = (uint32_t)indexSize(buffers[i].indexType);
+            entry.bounds = mesh.bounds;
+            entry.lodCount = (uint32_t)mesh.lods.size();
+            entry.reserved = 0;
+            entry.vertexOffset = offset;
+            offset = align(offset + entry.vertexCount * vertexStride(format));
+            entry.indexOffset = offset;
+            offset = align(offset + (uint64_t)entry.indexCount * entry.indexSize);
+            entry.textureOffset = offset;
+            offset = align(offset + entry.textureBytes);
+            entry.rangeOffset = offset;
+            offset = align(offset + entry.rangeCount * sizeof(DrawRange));
+            entry.lodOffset = offset;
+            offset = align(offset + entry.lodCount * sizeof(MeshLod));
+        }
+
+        string cachePath = pathFor(sourcePath);
+        string tempPath = cachePath + ".tmp";
+        {
+            ofstream out(tempPath, ios::binary | ios::trunc);
+            if (!out)
+                return false;
+            out.write((const char*)&header, sizeof(header));
+            out.write((const char*)entries.data(), entries.size() * sizeof(MeshCacheEntry));
+            pad(out);
+            for (size_t i = 0; i < meshes.size(); i++)
+            {
+                const MeshCacheEntry &entry = entries[i];
+                out.write((const char*)buffers[i].vertices, entry.vertexCount * vertexStride(format));
+                pad(out);
+                out.write((const char*)buffers[i].indices, (uint64_t)entry.indexCount * entry.indexSize);
+                pad(out);
+                out.write(textureTables[i].data(), textureTables[i].size());
+                pad(out);
+                out.write((const char*)buffers[i].ranges.data(), entry.rangeCount * sizeof(DrawRange));
+                pad(out);
+                out.write((const char*)meshes[i].lods.data(), entry.lodCount * sizeof(MeshLod));
+                pad(out);
+            }
+            if (!out)
+            {
+                out.close();
+                remove(tempPath.c_str());
+                return false;
+            }
+        }
+        return rename(tempPath.c_str(), cachePath.c_str()) == 0;
+    }
+
+private:
+    MappedFile file;
+    const MeshCacheHeader *header = nullptr;
+    const MeshCacheEntry *entries = nullptr;
+
+    static uint64_t align(uint64_t offset)
+    {
+        return (offset + 7) & ~(uint64_t)7;
+    }
+
+    static void pad(ofstream &out)
+    {
+        static const char zeros[8] = {};
+        uint64_t position = (uint64_t)out.tellp();
+        out.write(zeros, align(position) - position);
+    }
+
+    bool validate(VertexFormat format, unsigned int lodLevels)
+    {
+        if (file.size() < sizeof(MeshCacheHeader))
+            return false;
+        header = (const MeshCacheHeader*)file.data();
+        if (memcmp(header->magic, MESH_CACHE_MAGIC, sizeof(header->magic)) != 0
+            || header->version != MESH_CACHE_VERSION || header->vertexFormat != (uint32_t)format
+            || header->vertexSize != vertexStride(format) || header->lodLevels != lodLevels)
+            return false;
+        if (sizeof(MeshCacheHeader) + (uint64_t)header->meshCount * sizeof(MeshCacheEntry) > file.size())
+            return false;
+        entries = (const MeshCacheEntry*)(file.data() + sizeof(MeshCacheHeader));
+        for (unsigned int i = 0; i < header->meshCount; i++)
+        {
+            const MeshCacheEntry &entry = entries[i];
+            if (entry.indexSize != 2 && entry.indexSize != 4)
+                return false;
+            if (entry.vertexOffset + (uint64_t)entry.vertexCount * header->vertexSize > file.size()
+                || entry.indexOffset + (uint64_t)entry.indexCount * entry.indexSize > file.size()
+                || entry.textureOffset + entry.textureBytes > file.size()
+                || entry.rangeOffset + (uint64_t)entry.rangeCount * sizeof(DrawRange) > file.size()
+                || entry.lodOffset + (uint64_t)entry.lodCount * sizeof(MeshLod) > file.size())
+                return false;
+            // a range has to stay within the mesh's indices and start on one of its vertices. Where its largest
+            // possible index would reach past the vertices, which a 32 bit range always could, the indices are read.
+            // Without ranges the mesh is drawn as one 32 bit range over all its indices
+            const DrawRange *ranges = (const DrawRange*)(file.data() + entry.rangeOffset);
+            for (unsigned int r = 0; r < entry.rangeCount; r++)
+            {
+                const DrawRange &range = ranges[r];
+                if ((uint64_t)range.firstIndex + range.indexCount > entry.indexCount)
+                    return false;
+                if (range.indexCount == 0)
+                    continue;
+                if (range.baseVertex < 0 || (uint64_t)range.baseVertex >= entry.vertexCount)
+                    return false;
+                if (entry.indexSize == 2 && (uint64_t)range.baseVertex + 65535 < entry.vertexCount)
+                    continue;
+                if (!indicesWithin(entry, range))
+                    return false;
+            }
+            if (entry.rangeCount == 0 && entry.indexCount > 0 && !indicesWithin(entry, {0, entry.indexCount, 0}))
+                return false;
+            // no more levels than were asked for at import, and each one has to draw indices and ranges the mesh has
+            if (entry.lodCount > header->lodLevels || entry.lodCount > MAX_LOD_LEVELS)
+                return false;
+            const MeshLod *lods = (const MeshLod*)(file.data() + entry.lodOffset);
+            for (unsigned int lod = 0; lod < entry.lodCount; lod++)
+                if ((uint64_t)lods[lod].firstIndex + lods[lod].indexCount > entry.indexCount
+                    || (uint64_t)lods[lod].firstRange + lods[lod].rangeCount > entry.rangeCount)
+                    return false;
+            // the texture table has to end on a terminator, otherwise reading it would run off the mapping
+            if (entry.textureBytes > 0 && file.data()[entry.textureOffset + entry.textureBytes - 1] != '\0')
+                return false;
+        }
+        return true;
+    }
+
+    // whether every index of a range, offset by its base vertex, names one of the entry's vertices
+    bool indicesWithin(const MeshCacheEntry &entry, const DrawRange &range) const
+    {
+        const unsigned char *indices = file.data() + entry.indexOffset;
+        uint64_t limit = entry.vertexCount - (uint64_t)range.baseVertex;
+        for (unsigned int i = range.firstIndex; i < range.firstIndex + range.indexCount; i++)
+        {
+            uint32_t index = entry.indexSize == 2 ? ((const uint16_t*)indices)[i] : ((const uint32_t*)indices)[i];
+            if (index >= limit)
+                return false;
+        }
+        return true;
+    }
+
+    // remembers the new timestamp of an unchanged source so the next launch can skip hashing it
+    static void refreshStamp(const string &sourcePath, const SourceStamp &stamp)
+    {
+        FILE *out = fopen(pathFor(sourcePath).c_str(), "r+b");
+        if (!out)
+            return;
+        if (fseek(out, offsetof(MeshCacheHeader, sourceMtime), SEEK_SET) == 0)
+            fwrite(&stamp.mtime, sizeof(stamp.mtime), 1, out);
+        fclose(out);
+    }
+};
+
+// startup timing report, one entry per loaded model
+struct ModelLoadStat {
+    string path;
+    bool fromCache;
+    double importMillis; // CPU phase, may have run on a worker thread
+    double uploadMillis; // GL phase on the main thread
+    double assimpMillis; // Assimp import time, measured now or when the cache was written
+    // vertex cache efficiency over all meshes, only known when the model was imported and optimized just now
+    MeshOptimizeStats optimize;
+    size_t cpuBytes = 0; // resident CPU memory of the model after upload
+    // levels of detail the model asked for and the most any of its meshes got, the simplifier stops early on
+    // meshes it can barely reduce
+    unsigned int lodLevelsRequested = 1, lodLevelsBuilt = 1;
+};
+
+inline vector<ModelLoadStat> &modelLoadStats()
+{
+    static vector<ModelLoadStat> stats;
+    return stats;
+}
+
+inline double millisecondsSince(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+inline void printModelLoadReport(ostream &out = cout)
+{
+    double totalImport = 0.0, totalUpload = 0.0, totalAssimp = 0.0;
+    size_t totalCpuBytes = 0;
+    out << "Model load report (import / upload):" << endl;
+    for (const ModelLoadStat &stat : modelLoadStats())
+    {
+        out << "  " << left << setw(60) << stat.path << right
+            << (stat.fromCache ? " cache  " : " assimp ")
+            << fixed << setprecision(1) << setw(9) << stat.importMillis << " ms / " << setw(7) << stat.uploadMillis << " ms"
+            << setw(9) << stat.cpuBytes / 1024.0 << " KB resident";
+        if (stat.fromCache)
+            out << "  (assimp " << stat.assimpMillis << " ms, saved " << stat.assimpMillis - stat.importMillis << " ms)";
+        out << endl;
+        if (!stat.fromCache && stat.optimize.triangles > 0)
+            out << "      optimized: vertices " << stat.optimize.verticesBefore << " -> " << stat.optimize.verticesAfter
+                << setprecision(3) << ", ACMR " << stat.optimize.before.acmr << " -> " << stat.optimize.after.acmr
+                << ", ATVR " << stat.optimize.before.atvr << " -> " << stat.optimize.after.atvr << setprecision(1)
+                << ", index bytes " << stat.optimize.indexBytesBefore << " -> " << stat.optimize.indexBytesAfter << endl;
+        if (stat.lodLevelsRequested > 1)
+        {
+            out << "      levels of detail: " << stat.lodLevelsBuilt << " of " << stat.lodLevelsRequested << " built";
+            if (!stat.fromCache)
+            {
+                out << ", triangles " << stat.optimize.lodTriangles[0];
+                for (unsigned int level = 1; level < stat.lodLevelsBuilt && level < MAX_LOD_LEVELS; level++)
+                    out << " / " << stat.optimize.lodTriangles[level];
+            }
+            out << endl;
+        }
+        totalImport += stat.importMillis;
+        totalUpload += stat.uploadMillis;
+        totalAssimp += stat.assimpMillis;
+        totalCpuBytes += stat.cpuBytes;
+    }
+    out << "  total " << fixed << setprecision(1) << totalImport << " ms / " << totalUpload
+        << " ms, import without the cache " << totalAssimp << " ms, " << totalCpuBytes / 1024.0 << " KB resident" << endl;
+    out.unsetf(ios::floatfield);
+}
+#endif
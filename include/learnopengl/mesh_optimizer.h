@@ -0,0 +1,476 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <learnopengl/mesh.h>
+#include <learnopengl/mesh_simplifier.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+// Import time mesh optimization, run on every mesh before it is cached and uploaded:
+//   1. duplicate vertices are welded, Assimp emits one vertex per face corner for OBJ files
+//   2. triangles are reordered for the post-transform vertex cache (Tom Forsyth's linear speed optimizer)
+//   3. the result is cut into clusters of roughly the cache's working set (Sander, Nehab and Barczak, "Fast Triangle
+//      Reordering for Vertex Locality and Reduced Overdraw"), which are sorted front to back from the outside in
+//   4. vertices are reordered by first use, so vertex fetch walks the buffer linearly
+//   5. simplified levels of detail are appended to the indices when the model asks for them
+//   6. indices are narrowed to 16 bit wherever the vertex count allows it
+const unsigned int VERTEX_CACHE_OPTIMIZE_SIZE = 32; // LRU cache modelled while reordering
+const unsigned int VERTEX_CACHE_ANALYZE_SIZE = 16;  // FIFO cache used to report ACMR/ATVR, closer to real hardware
+const unsigned int MIN_TRIANGLES_PER_RANGE = 1024;  // shorter draw ranges cost more in draw calls than 16 bit indices save
+const unsigned int MAX_LOD_LEVELS = 4;              // the full mesh and up to three simplified levels
+const float OVERDRAW_CLUSTER_ACMR = 1.05f;          // a cluster ends once its ACMR is within this factor of its whole run's
+const float LOD_TRIANGLE_RATIO = 0.5f;              // each level aims for this share of the previous level's triangles
+const float LOD_MIN_REDUCTION = 0.85f;              // a level keeping more than this share is not worth its indices
+const float LOD_MAX_ERROR = 0.05f;                  // no level moves the surface further than this share of the bounding radius
+
+struct VertexCacheStats {
+    float acmr = 0.0f; // transformed vertices per triangle, 0.5 is ideal and 3 the worst
+    float atvr = 0.0f; // transformed vertices per vertex, 1 is ideal
+};
+
+struct MeshOptimizeStats {
+    VertexCacheStats before, after; // before is measured on the welded mesh in its original triangle order
+    unsigned int verticesBefore = 0, verticesAfter = 0;
+    unsigned int triangles = 0;
+    size_t indexBytesBefore = 0, indexBytesAfter = 0;
+    unsigned int lodTriangles[MAX_LOD_LEVELS] = {}; // per level of detail, meshes with fewer levels count their last one
+};
+
+// simulates a FIFO post-transform cache over the index buffer
+inline VertexCacheStats analyzeVertexCache(const vector<unsigned int> &indices, size_t vertexCount,
+                                           unsigned int cacheSize = VERTEX_CACHE_ANALYZE_SIZE)
+{
+    VertexCacheStats stats;
+    if (indices.size() < 3 || vertexCount == 0)
+        return stats;
+    // a vertex is in the cache while fewer than cacheSize misses happened since it was loaded
+    vector<unsigned int> loadedAt(vertexCount, 0);
+    unsigned int misses = 0;
+    for (unsigned int index : indices)
+    {
+        if (loadedAt[index] == 0 || misses - loadedAt[index] >= cacheSize)
+            loadedAt[index] = ++misses;
+    }
+    stats.acmr = (float)misses / (indices.size() / 3);
+    stats.atvr = (float)misses / vertexCount;
+    return stats;
+}
+
+// merges bitwise identical vertices and rewrites the indices to match
+inline void weldVertices(vector<Vertex> &vertices, vector<unsigned int> &indices)
+{
+    struct VertexHash {
+        size_t operator()(const Vertex &vertex) const
+        {
+            const unsigned char *bytes = (const unsigned char*)&vertex;
+            uint64_t hash = 14695981039346656037ULL;
+            for (size_t i = 0; i < sizeof(Vertex); i++)
+                hash = (hash ^ bytes[i]) * 1099511628211ULL;
+            return (size_t)hash;
+        }
+    };
+    struct VertexEqual {
+        bool operator()(const Vertex &a, const Vertex &b) const { return memcmp(&a, &b, sizeof(Vertex)) == 0; }
+    };
+
+    unordered_map<Vertex, unsigned int, VertexHash, VertexEqual> unique;
+    unique.reserve(vertices.size());
+    vector<unsigned int> remap(vertices.size());
+    vector<Vertex> welded;
+    welded.reserve(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++)
+    {
+        auto inserted = unique.insert(make_pair(vertices[i], (unsigned int)welded.size()));
+        if (inserted.second)
+            welded.push_back(vertices[i]);
+        remap[i] = inserted.first->second;
+    }
+    for (unsigned int &index : indices)
+        index = remap[index];
+    vertices.swap(welded);
+}
+
+// Forsyth's vertex cache optimization: greedily emits the triangle with the best score, where vertices score high
+// when they were used recently and when few of their triangles are left. clusterStarts receives the position
+// (in triangles) of every point where no triangle touching the cache was left, the cache is cold there anyway.
+inline void optimizeVertexCache(vector<unsigned int> &indices, size_t vertexCount, vector<unsigned int> *clusterStarts = nullptr)
+{
+    const float cacheDecayPower = 1.5f;
+    const float lastTriangleScore = 0.75f;
+    const float valenceBoostScale = 2.0f;
+    const float valenceBoostPower = 0.5f;
+    const int cacheSize = (int)VERTEX_CACHE_OPTIMIZE_SIZE;
+
+    size_t triangleCount = indices.size() / 3;
+    if (clusterStarts)
+        clusterStarts->clear();
+    if (triangleCount == 0)
+        return;
+
+    struct VertexState {
+        int cachePosition = -1;
+        unsigned int liveTriangles = 0;
+        unsigned int firstTriangle = 0; // into the adjacency list
+        float score = 0.0f;
+    };
+    vector<VertexState> vertices(vertexCount);
+    for (unsigned int index : indices)
+        vertices[index].liveTriangles++;
+    vector<unsigned int> adjacency(indices.size());
+    {
+        unsigned int offset = 0;
+        for (VertexState &vertex : vertices)
+        {
+            vertex.firstTriangle = offset;
+            offset += vertex.liveTriangles;
+        }
+        vector<unsigned int> filled(vertexCount, 0);
+        for (size_t i = 0; i < indices.size(); i++)
+            adjacency[vertices[indices[i]].firstTriangle + filled[indices[i]]++] = (unsigned int)(i / 3);
+    }
+
+    auto vertexScore = [&](const VertexState &vertex) {
+        if (vertex.liveTriangles == 0)
+            return -1.0f;
+        float score = 0.0f;
+        if (vertex.cachePosition >= 0)
+        {
+            if (vertex.cachePosition < 3)
+                score = lastTriangleScore; // part of the triangle just drawn, scored flat so no direction is preferred
+            else
+                score = pow(1.0f - (float)(vertex.cachePosition - 3) / (cacheSize - 3), cacheDecayPower);
+        }
+        return score + valenceBoostScale * pow((float)vertex.liveTriangles, -valenceBoostPower);
+    };
+
+    for (VertexState &vertex : vertices)
+        vertex.score = vertexScore(vertex);
+    vector<bool> emitted(triangleCount, false);
+
+    vector<unsigned int> result;
+    result.reserve(indices.size());
+    vector<unsigned int> cache, nextCache;
+    cache.reserve(cacheSize + 3);
+    nextCache.reserve(cacheSize + 3);
+    size_t scanCursor = 0;
+    long best = -1;
+    while (result.size() < indices.size())
+    {
+        if (best < 0)
+        {
+            // nothing adjacent to the cache is left, continue with the next triangle in input order
+            while (scanCursor < triangleCount && emitted[scanCursor])
+                scanCursor++;
+            best = (long)scanCursor;
+            if (clusterStarts)
+                clusterStarts->push_back((unsigned int)(result.size() / 3));
+        }
+
+        const unsigned int *triangle = &indices[3 * best];
+        emitted[best] = true;
+        nextCache.clear();
+        for (int k = 0; k < 3; k++)
+        {
+            result.push_back(triangle[k]);
+            VertexState &vertex = vertices[triangle[k]];
+            // drop the triangle from the vertex's live list
+            unsigned int *live = &adjacency[vertex.firstTriangle];
+            for (unsigned int j = 0; j < vertex.liveTriangles; j++)
+                if (live[j] == (unsigned int)best)
+                {
+                    swap(live[j], live[vertex.liveTriangles - 1]);
+                    break;
+                }
+            vertex.liveTriangles--;
+            if (find(nextCache.begin(), nextCache.end(), triangle[k]) == nextCache.end()) // degenerate triangles repeat a vertex
+                nextCache.push_back(triangle[k]);
+        }
+        for (unsigned int index : cache)
+            if (index != triangle[0] && index != triangle[1] && index != triangle[2])
+                nextCache.push_back(index);
+        cache.swap(nextCache);
+
+        // rescore everything that moved, vertices pushed out of the cache lose their cache bonus
+        for (size_t position = 0; position < cache.size(); position++)
+        {
+            VertexState &vertex = vertices[cache[position]];
+            vertex.cachePosition = position < (size_t)cacheSize ? (int)position : -1;
+            vertex.score = vertexScore(vertex);
+        }
+        if (cache.size() > (size_t)cacheSize)
+            cache.resize(cacheSize);
+
+        // the next triangle is the best one touching the cache
+        best = -1;
+        float bestScore = -1.0f;
+        for (unsigned int index : cache)
+        {
+            const VertexState &vertex = vertices[index];
+            for (unsigned int j = 0; j < vertex.liveTriangles; j++)
+            {
+                unsigned int t = adjacency[vertex.firstTriangle + j];
+                float score = vertices[indices[3 * t]].score + vertices[indices[3 * t + 1]].score + vertices[indices[3 * t + 2]].score;
+                if (score > bestScore)
+                {
+                    bestScore = score;
+                    best = t;
+                }
+            }
+        }
+    }
+    indices.swap(result);
+}
+
+// cuts the runs between the cold restarts of optimizeVertexCache into the clusters optimizeOverdraw sorts. A connected
+// mesh restarts only a handful of times, so every run is walked with the FIFO cache of analyzeVertexCache and a
+// cluster is closed as soon as its own ACMR has come down to OVERDRAW_CLUSTER_ACMR times the ACMR of the whole run.
+// The cache starts cold at every cluster, as it will once the clusters are reordered, so cutting more often than
+// that would cost more vertex transforms than the sorting saves in overdraw
+inline vector<unsigned int> splitClusters(const vector<unsigned int> &indices, size_t vertexCount,
+                                          const vector<unsigned int> &clusterStarts)
+{
+    const unsigned int cacheSize = VERTEX_CACHE_ANALYZE_SIZE;
+    size_t triangleCount = indices.size() / 3;
+    vector<unsigned int> loadedAt(vertexCount, 0);
+    unsigned int misses = 0, coldAt = 0;   // loads up to coldAt belong to earlier clusters
+    auto load = [&](unsigned int index) {
+        if (loadedAt[index] > coldAt && misses - loadedAt[index] < cacheSize)
+            return 0u;
+        loadedAt[index] = ++misses;
+        return 1u;
+    };
+
+    vector<unsigned int> result;
+    for (size_t c = 0; c < clusterStarts.size(); c++)
+    {
+        unsigned int begin = clusterStarts[c];
+        unsigned int end = c + 1 < clusterStarts.size() ? clusterStarts[c + 1] : (unsigned int)triangleCount;
+        coldAt = misses;
+        unsigned int runMisses = 0;
+        for (unsigned int t = begin; t < end; t++)
+            for (int k = 0; k < 3; k++)
+                runMisses += load(indices[3 * t + k]);
+        float threshold = OVERDRAW_CLUSTER_ACMR * runMisses / (end - begin);
+
+        result.push_back(begin);
+        coldAt = misses;
+        unsigned int clusterMisses = 0, clusterTriangles = 0;
+        for (unsigned int t = begin; t < end; t++)
+        {
+            for (int k = 0; k < 3; k++)
+                clusterMisses += load(indices[3 * t + k]);
+            clusterTriangles++;
+            if ((float)clusterMisses / clusterTriangles <= threshold && t + 1 < end)
+            {
+                result.push_back(t + 1);
+                coldAt = misses;
+                clusterMisses = clusterTriangles = 0;
+            }
+        }
+        // the last cluster stopped short of the threshold, it joins the one before
+        if (clusterTriangles > 0 && result.size() > 1 && result.back() != begin)
+            result.pop_back();
+    }
+    return result;
+}
+
+// sorts the clusters produced by splitClusters so that the ones facing away from the mesh center are drawn
+// first, they are the most likely to occlude the rest. Triangle order inside a cluster is kept, so the
+// vertex cache efficiency only suffers at the cluster seams.
+inline void optimizeOverdraw(vector<unsigned int> &indices, const vector<Vertex> &vertices, const vector<unsigned int> &clusterStarts)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (clusterStarts.size() < 2 || triangleCount == 0)
+        return;
+
+    glm::vec3 meshCenter(0.0f);
+    for (unsigned int index : indices)
+        meshCenter += vertices[index].Position;
+    meshCenter /= (float)indices.size();
+
+    struct Cluster {
+        unsigned int begin, end;
+        float sortKey;
+    };
+    vector<Cluster> clusters;
+    for (size_t c = 0; c < clusterStarts.size(); c++)
+    {
+        Cluster cluster;
+        cluster.begin = clusterStarts[c];
+        cluster.end = c + 1 < clusterStarts.size() ? clusterStarts[c + 1] : (unsigned int)triangleCount;
+        glm::vec3 center(0.0f), normal(0.0f);
+        for (unsigned int t = cluster.begin; t < cluster.end; t++)
+        {
+            const glm::vec3 &a = vertices[indices[3 * t]].Position;
+            const glm::vec3 &b = vertices[indices[3 * t + 1]].Position;
+            const glm::vec3 &c = vertices[indices[3 * t + 2]].Position;
+            center += a + b + c;
+            normal += glm::cross(b - a, c - a); // area weighted
+        }
+        center /= (float)(3 * (cluster.end - cluster.begin));
+        float length = glm::length(normal);
+        cluster.sortKey = length > 0.0f ? glm::dot(center - meshCenter, normal / length) : 0.0f;
+        clusters.push_back(cluster);
+    }
+    stable_sort(clusters.begin(), clusters.end(), [](const Cluster &a, const Cluster &b) { return a.sortKey > b.sortKey; });
+
+    vector<unsigned int> sorted;
+    sorted.reserve(indices.size());
+    for (const Cluster &cluster : clusters)
+        sorted.insert(sorted.end(), indices.begin() + 3 * cluster.begin, indices.begin() + 3 * cluster.end);
+    indices.swap(sorted);
+}
+
+// renumbers the vertices in the order the indices first reference them, unreferenced vertices are dropped
+inline void optimizeVertexFetch(vector<Vertex> &vertices, vector<unsigned int> &indices)
+{
+    const unsigned int unused = ~0u;
+    vector<unsigned int> remap(vertices.size(), unused);
+    vector<Vertex> ordered;
+    ordered.reserve(vertices.size());
+    for (unsigned int &index : indices)
+    {
+        if (remap[index] == unused)
+        {
+            remap[index] = (unsigned int)ordered.size();
+            ordered.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+    vertices.swap(ordered);
+}
+
+// appends up to levels - 1 simplified levels to the mesh's indices, each simplified from the one before to about
+// half its triangles, and fills mesh.lods with level 0 (the full mesh) first. Every level gets its own vertex cache
+// order; vertex fetch stays ordered for the full level, the coarser ones only touch a subset of its vertices.
+// Stops early when a level barely shrinks or would move the surface too far
+inline void buildLods(MeshData &mesh, unsigned int levels)
+{
+    mesh.lods.clear();
+    levels = min(levels, MAX_LOD_LEVELS);
+    if (levels < 2 || mesh.indices.empty())
+        return;
+    mesh.lods.push_back({0, (unsigned int)mesh.indices.size(), 0, 0, 0.0f});
+    float maxError = LOD_MAX_ERROR * mesh.bounds.radius;
+    vector<unsigned int> previous(mesh.indices);
+    for (unsigned int level = 1; level < levels; level++)
+    {
+        float errorLeft = maxError - mesh.lods.back().error;
+        if (errorLeft <= 0.0f)
+            break;
+        size_t target = (size_t)(previous.size() / 3 * LOD_TRIANGLE_RATIO) * 3;
+        float levelError;
+        vector<unsigned int> simplified = simplifyIndices(mesh.vertices, previous, target, errorLeft, levelError);
+        if (simplified.empty() || simplified.size() > previous.size() * LOD_MIN_REDUCTION)
+            break;
+        optimizeVertexCache(simplified, mesh.vertices.size());
+        // the quadrics start over on every level, the errors of the levels before add up
+        mesh.lods.push_back({(unsigned int)mesh.indices.size(), (unsigned int)simplified.size(), 0, 0, mesh.lods.back().error + levelError});
+        mesh.indices.insert(mesh.indices.end(), simplified.begin(), simplified.end());
+        previous.swap(simplified);
+    }
+    if (mesh.lods.size() < 2)
+        mesh.lods.clear();
+}
+
+// fills shortIndices and ranges when the mesh can be drawn with 16 bit indices. Meshes with more than 65536 vertices
+// are cut into ranges of consecutive triangles whose vertices span less than that, each drawn with its own base vertex.
+// after optimizeVertexFetch the referenced vertices grow almost monotonically, so the ranges come out long.
+// Levels of detail get ranges of their own, no range crosses from one level into the next.
+// returns false, leaving the mesh on 32 bit indices, if the ranges would get too short to pay off
+inline bool narrowIndices(MeshData &mesh)
+{
+    const unsigned int maxSpan = 65535;
+    mesh.shortIndices.clear();
+    mesh.ranges.clear();
+    if (mesh.indices.empty())
+        return false;
+    vector<MeshLod> levels = mesh.lods;
+    if (levels.empty())
+        levels.push_back({0, (unsigned int)mesh.indices.size(), 0, 0, 0.0f});
+    vector<DrawRange> ranges;
+    for (MeshLod &level : levels)
+    {
+        level.firstRange = (unsigned int)ranges.size();
+        unsigned int end = level.firstIndex + level.indexCount;
+        unsigned int low = ~0u, high = 0, first = level.firstIndex;
+        for (unsigned int t = level.firstIndex; t + 2 < end; t += 3)
+        {
+            const unsigned int *triangle = &mesh.indices[t];
+            unsigned int triangleLow = min(triangle[0], min(triangle[1], triangle[2]));
+            unsigned int triangleHigh = max(triangle[0], max(triangle[1], triangle[2]));
+            if (max(high, triangleHigh) - min(low, triangleLow) > maxSpan)
+            {
+                ranges.push_back({first, t - first, (int)low});
+                first = t;
+                low = triangleLow;
+                high = triangleHigh;
+            }
+            else
+            {
+                low = min(low, triangleLow);
+                high = max(high, triangleHigh);
+            }
+        }
+        if (end > first)
+            ranges.push_back({first, end - first, (int)low});
+        level.rangeCount = (unsigned int)ranges.size() - level.firstRange;
+    }
+    if (ranges.size() > levels.size() && mesh.indices.size() / 3 / ranges.size() < MIN_TRIANGLES_PER_RANGE)
+    {
+        // 32 bit indices, one range per level
+        for (unsigned int i = 0; i < mesh.lods.size(); i++)
+        {
+            MeshLod &level = mesh.lods[i];
+            mesh.ranges.push_back({level.firstIndex, level.indexCount, 0});
+            level.firstRange = i;
+            level.rangeCount = 1;
+        }
+        return false;
+    }
+
+    mesh.shortIndices.resize(mesh.indices.size());
+    for (const DrawRange &range : ranges)
+        for (unsigned int i = range.firstIndex; i < range.firstIndex + range.indexCount; i++)
+            mesh.shortIndices[i] = (uint16_t)(mesh.indices[i] - range.baseVertex);
+    mesh.ranges = ranges;
+    if (!mesh.lods.empty())
+        mesh.lods = levels;
+    return true;
+}
+
+// runs the whole optimization pipeline on an imported mesh, lodLevels counts the full mesh as one level
+inline MeshOptimizeStats optimizeMesh(MeshData &mesh, unsigned int lodLevels = 1)
+{
+    MeshOptimizeStats stats;
+    stats.verticesBefore = (unsigned int)mesh.vertices.size();
+    stats.triangles = (unsigned int)(mesh.indices.size() / 3);
+
+    weldVertices(mesh.vertices, mesh.indices);
+    stats.before = analyzeVertexCache(mesh.indices, mesh.vertices.size());
+    vector<unsigned int> clusterStarts;
+    optimizeVertexCache(mesh.indices, mesh.vertices.size(), &clusterStarts);
+    optimizeOverdraw(mesh.indices, mesh.vertices, splitClusters(mesh.indices, mesh.vertices.size(), clusterStarts));
+    optimizeVertexFetch(mesh.vertices, mesh.indices);
+
+    stats.verticesAfter = (unsigned int)mesh.vertices.size();
+    stats.after = analyzeVertexCache(mesh.indices, mesh.vertices.size());
+
+    stats.indexBytesBefore = mesh.indices.size() * sizeof(unsigned int);
+    buildLods(mesh, lodLevels);
+    for (unsigned int level = 0; level < MAX_LOD_LEVELS; level++)
+        stats.lodTriangles[level] = mesh.lods.empty() ? stats.triangles
+                                    : mesh.lods[min(level, (unsigned int)mesh.lods.size() - 1)].indexCount / 3;
+
+    // the levels of detail are part of the index buffer after, so it can come out larger than before
+    stats.indexBytesAfter = narrowIndices(mesh) ? mesh.shortIndices.size() * sizeof(uint16_t) : mesh.indices.size() * sizeof(unsigned int);
+    return stats;
+}
+#endif
@@ -0,0 +1,281 @@
+#ifndef MESH_SIMPLIFIER_H
+#define MESH_SIMPLIFIER_H
+
+#include <learnopengl/mesh.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+// Import time mesh simplification for the levels of detail (Garland and Heckbert, "Surface Simplification Using
+// Quadric Error Metrics"). Edges are collapsed as half edges, one end moves onto the other, so every level draws
+// from the full mesh's vertex buffer and only needs indices of its own.
+// Vertices sharing a position (UV or normal seams) form one corner of the surface and move together: each of them
+// onto the vertex of the target corner it shares a triangle with, so a seam collapses along itself and stays closed.
+// A corner where some vertex has no such partner stays put, the level could only tear there. Corners on open
+// borders never move either, the silhouettes of the terrain pieces meet other pieces there and would open cracks.
+
+// the sum of the squared distances to a set of planes as a symmetric 4x4 matrix. Every plane counts once,
+// so the square root of Error(p) bounds the distance of p to each one of them
+struct Quadric {
+    double a00 = 0.0, a01 = 0.0, a02 = 0.0, a11 = 0.0, a12 = 0.0, a22 = 0.0;
+    double b0 = 0.0, b1 = 0.0, b2 = 0.0;
+    double c = 0.0;
+
+    // the plane dot(normal, p) + distance = 0, normal of unit length
+    void AddPlane(double nx, double ny, double nz, double distance)
+    {
+        a00 += nx * nx; a01 += nx * ny; a02 += nx * nz;
+        a11 += ny * ny; a12 += ny * nz; a22 += nz * nz;
+        b0 += nx * distance; b1 += ny * distance; b2 += nz * distance;
+        c += distance * distance;
+    }
+
+    void Add(const Quadric &other)
+    {
+        a00 += other.a00; a01 += other.a01; a02 += other.a02;
+        a11 += other.a11; a12 += other.a12; a22 += other.a22;
+        b0 += other.b0; b1 += other.b1; b2 += other.b2;
+        c += other.c;
+    }
+
+    double Error(const glm::vec3 &p) const
+    {
+        double x = p.x, y = p.y, z = p.z;
+        return a00 * x * x + a11 * y * y + a22 * z * z + 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z)
+               + 2.0 * (b0 * x + b1 * y + b2 * z) + c;
+    }
+};
+
+// Collapses edges of the triangles in indices, cheapest first, until at most targetIndexCount indices are left or
+// every remaining collapse would move the surface further than maxError. Returns the indices of the simplified
+// triangles, over the same vertices, and sets error to a bound on how far any corner ended up from the planes of
+// the original triangles it absorbed, the largest distance the level moved the surface.
+// Runs in passes: each pass sorts all candidate collapses once and applies the cheap ones whose neighbourhoods do
+// not overlap, which keeps the cost estimates valid without a priority queue that has to be updated
+inline vector<unsigned int> simplifyIndices(const vector<Vertex> &vertices, const vector<unsigned int> &indices,
+                                            size_t targetIndexCount, float maxError, float &error)
+{
+    error = 0.0f;
+    vector<unsigned int> result = indices;
+    if (indices.size() < 3 || vertices.empty())
+        return result;
+
+    // vertices sharing a position are one corner of the surface, they carry one quadric and move together
+    struct PositionHash {
+        size_t operator()(const glm::vec3 &p) const
+        {
+            uint32_t bits[3];
+            memcpy(bits, &p.x, sizeof(float));
+            memcpy(bits + 1, &p.y, sizeof(float));
+            memcpy(bits + 2, &p.z, sizeof(float));
+            return (size_t)(bits[0] * 73856093u ^ bits[1] * 19349663u ^ bits[2] * 83492791u);
+        }
+    };
+    struct PositionEqual {
+        bool operator()(const glm::vec3 &a, const glm::vec3 &b) const { return a.x == b.x && a.y == b.y && a.z == b.z; }
+    };
+    unordered_map<glm::vec3, unsigned int, PositionHash, PositionEqual> cornerOf;
+    cornerOf.reserve(vertices.size());
+    vector<unsigned int> corner(vertices.size());
+    vector<unsigned int> firstOfCorner;   // vertices per corner, made into offsets into cornerVertices below
+    for (size_t i = 0; i < vertices.size(); i++)
+    {
+        auto inserted = cornerOf.insert(make_pair(vertices[i].Position, (unsigned int)firstOfCorner.size()));
+        if (inserted.second)
+            firstOfCorner.push_back(0);
+        corner[i] = inserted.first->second;
+        firstOfCorner[corner[i]]++;
+    }
+    size_t cornerCount = firstOfCorner.size();
+    vector<unsigned int> cornerVertices(vertices.size());
+    {
+        unsigned int offset = 0;
+        for (unsigned int &first : firstOfCorner)
+        {
+            unsigned int count = first;
+            first = offset;
+            offset += count;
+        }
+        firstOfCorner.push_back(offset);
+        vector<unsigned int> filled(firstOfCorner.begin(), firstOfCorner.end() - 1);
+        for (size_t i = 0; i < vertices.size(); i++)
+            cornerVertices[filled[corner[i]]++] = (unsigned int)i;
+    }
+
+    vector<Quadric> quadrics(cornerCount);
+    for (size_t t = 0; t + 2 < indices.size(); t += 3)
+    {
+        const glm::vec3 &a = vertices[indices[t]].Position;
+        const glm::vec3 &b = vertices[indices[t + 1]].Position;
+        const glm::vec3 &c = vertices[indices[t + 2]].Position;
+        glm::vec3 normal = glm::cross(b - a, c - a);
+        float length = glm::length(normal);
+        if (length <= 0.0f)
+            continue;
+        normal /= length;
+        Quadric plane;
+        plane.AddPlane(normal.x, normal.y, normal.z, -glm::dot(normal, a));
+        for (int k = 0; k < 3; k++)
+            quadrics[corner[indices[t + k]]].Add(plane);
+    }
+
+    struct Collapse {
+        unsigned int from, to;
+        float cost; // squared distance
+    };
+    auto collapseCost = [&](unsigned int from, unsigned int to) {
+        Quadric merged = quadrics[corner[from]];
+        merged.Add(quadrics[corner[to]]);
+        return (float)max(0.0, merged.Error(vertices[to].Position));
+    };
+
+    float maxCost = maxError * maxError;
+    const unsigned int none = ~0u;
+    vector<unsigned int> firstTriangle(vertices.size() + 1), adjacency, remap(vertices.size()), partners;
+    vector<bool> locked(cornerCount), touched(cornerCount);
+    unordered_map<uint64_t, unsigned int> edgeUses;
+    vector<Collapse> collapses;
+    while (result.size() > targetIndexCount)
+    {
+        // triangles around every vertex
+        fill(firstTriangle.begin(), firstTriangle.end(), 0);
+        for (unsigned int index : result)
+            firstTriangle[index + 1]++;
+        for (size_t v = 0; v < vertices.size(); v++)
+            firstTriangle[v + 1] += firstTriangle[v];
+        adjacency.resize(result.size());
+        {
+            vector<unsigned int> filled(firstTriangle.begin(), firstTriangle.end() - 1);
+            for (size_t i = 0; i < result.size(); i++)
+                adjacency[filled[result[i]]++] = (unsigned int)(i / 3);
+        }
+
+        // an edge used by anything but exactly two triangles is a border (or non-manifold), its corners stay put.
+        // Collapses can make new ones, so they are found again on every pass
+        fill(locked.begin(), locked.end(), false);
+        edgeUses.clear();
+        edgeUses.reserve(result.size());
+        for (size_t t = 0; t + 2 < result.size(); t += 3)
+            for (int e = 0; e < 3; e++)
+            {
+                unsigned int a = corner[result[t + e]], b = corner[result[t + (e + 1) % 3]];
+                edgeUses[(uint64_t)min(a, b) << 32 | max(a, b)]++;
+            }
+        for (const auto &edge : edgeUses)
+            if (edge.second != 2)
+                locked[edge.first >> 32] = locked[edge.first & 0xffffffffu] = true;
+
+        collapses.clear();
+        for (size_t t = 0; t + 2 < result.size(); t += 3)
+            for (int e = 0; e < 3; e++)
+            {
+                unsigned int a = result[t + e], b = result[t + (e + 1) % 3];
+                if (!locked[corner[a]])
+                    collapses.push_back({a, b, collapseCost(a, b)});
+                if (!locked[corner[b]])
+                    collapses.push_back({b, a, collapseCost(b, a)});
+            }
+        if (collapses.empty())
+            break;
+        sort(collapses.begin(), collapses.end(), [](const Collapse &a, const Collapse &b) { return a.cost < b.cost; });
+
+        // a collapse removes about two triangles
+        size_t wanted = (result.size() - targetIndexCount) / 6 + 1;
+        size_t applied = 0;
+        fill(touched.begin(), touched.end(), false);
+        for (size_t v = 0; v < vertices.size(); v++)
+            remap[v] = (unsigned int)v;
+        for (const Collapse &collapse : collapses)
+        {
+            if (applied >= wanted || collapse.cost > maxCost)
+                break;
+            unsigned int from = corner[collapse.from], to = corner[collapse.to];
+            if (touched[from] || touched[to])
+                continue;
+
+            // every vertex of the corner still in use moves onto the one vertex of the target corner it shares a
+            // triangle with. None or several, and the collapse would tear the seam
+            partners.assign(firstOfCorner[from + 1] - firstOfCorner[from], none);
+            bool tears = false;
+            for (unsigned int k = 0; k < partners.size() && !tears; k++)
+            {
+                unsigned int v = cornerVertices[firstOfCorner[from] + k];
+                bool used = firstTriangle[v] < firstTriangle[v + 1];
+                for (unsigned int i = firstTriangle[v]; i < firstTriangle[v + 1] && !tears; i++)
+                    for (int j = 0; j < 3; j++)
+                    {
+                        unsigned int w = result[3 * adjacency[i] + j];
+                        if (corner[w] != to)
+                            continue;
+                        tears = partners[k] != none && partners[k] != w;
+                        partners[k] = w;
+                    }
+                tears = tears || (used && partners[k] == none);
+            }
+            if (tears)
+                continue;
+
+            // the triangles around the corner that survive must not turn over, nor tilt far enough to end up as
+            // slivers that the next pass turns over
+            const glm::vec3 &target = vertices[collapse.to].Position;
+            bool flips = false;
+            for (unsigned int k = 0; k < partners.size() && !flips; k++)
+            {
+                unsigned int v = cornerVertices[firstOfCorner[from] + k];
+                for (unsigned int i = firstTriangle[v]; i < firstTriangle[v + 1] && !flips; i++)
+                {
+                    const unsigned int *triangle = &result[3 * adjacency[i]];
+                    if (corner[triangle[0]] == to || corner[triangle[1]] == to || corner[triangle[2]] == to)
+                        continue;
+                    glm::vec3 before[3], after[3];
+                    for (int j = 0; j < 3; j++)
+                    {
+                        before[j] = vertices[triangle[j]].Position;
+                        after[j] = corner[triangle[j]] == from ? target : before[j];
+                    }
+                    glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+                    glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+                    flips = glm::dot(normalBefore, normalAfter) <= 0.25f * glm::length(normalBefore) * glm::length(normalAfter);
+                }
+            }
+            if (flips)
+                continue;
+
+            for (unsigned int k = 0; k < partners.size(); k++)
+            {
+                unsigned int v = cornerVertices[firstOfCorner[from] + k];
+                for (unsigned int i = firstTriangle[v]; i < firstTriangle[v + 1]; i++)
+                    for (int j = 0; j < 3; j++)
+                        touched[corner[result[3 * adjacency[i] + j]]] = true;
+                if (partners[k] != none)
+                    remap[v] = partners[k];
+            }
+            quadrics[to].Add(quadrics[from]);
+            error = max(error, sqrt(collapse.cost));
+            applied++;
+        }
+        if (applied == 0)
+            break;
+
+        // triangles that lost a corner are gone
+        size_t kept = 0;
+        for (size_t t = 0; t + 2 < result.size(); t += 3)
+        {
+            unsigned int a = remap[result[t]], b = remap[result[t + 1]], c = remap[result[t + 2]];
+            if (corner[a] == corner[b] || corner[b] == corner[c] || corner[a] == corner[c])
+                continue;
+            result[kept++] = a;
+            result[kept++] = b;
+            result[kept++] = c;
+        }
+        result.resize(kept);
+    }
+    return result;
+}
+#endif
@@ -11,13 +11,18 @@
 #include <assimp/postprocess.h>
 
 #include <learnopengl/mesh.h>
+#include <learnopengl/mesh_cache.h>
+#include <learnopengl/mesh_optimizer.h>
 #include <learnopengl/shader.h>
+#include <learnopengl/texture_registry.h>
 
+#include <chrono>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <map>
+#include <memory>
 #include <vector>
 
 using namespace std;
@@ -30,33 +35,63 @@ class Model
 {
 public:
     // model data
-    vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
+    vector<Texture> textures_loaded;	// every texture reference this model holds in the texture registry
     vector<Mesh>    meshes;
     string directory;
     bool gammaCorrection;
+    VertexFormat vertexFormat;
+    // keeps the vertices and indices of the meshes on the CPU after upload, for picking or collision.
+    // has to be set before Upload
+    bool retainCpuData = false;
+    // levels of detail built at import, counting the full meshes as one, so 1 builds none (see buildLods).
+    // has to be set before Import
+    unsigned int lodLevels = 1;
+    // how far each level of detail moves the surface at most, in model space units, the largest over all meshes.
+    // lodErrors[0] is 0, the size is the number of levels the meshes have
+    vector<float> lodErrors;
+    // one vertex and one element buffer hold all meshes, drawn through a single VAO
+    unsigned int VAO = 0, VBO = 0, EBO = 0;
+    // per-instance model matrices of DrawInstanced, wired to the VAO's instance attributes
+    unsigned int instanceVBO = 0;
+    // per-instance level of detail fades of DrawInstanced, wired to INSTANCE_FADE_ATTRIBUTE
+    unsigned int instanceFadeVBO = 0;
+    // model space bounds enclosing all meshes, what the culling tests since a model draws as a whole
+    MeshBounds bounds;
 
     // constructor, expects a filepath to a 3D model.
-    Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
+    Model(string const &path, bool gamma = false, VertexFormat format = VertexFormat::Full) : gammaCorrection(gamma)
     {
-        loadModel(path);
+        Import(path, format);
+        Upload();
     }
 
-    // draws the model, and thus all its meshes
-    void Draw(Shader &shader)
+    // creates an empty model that is filled later through Import and Upload (see ModelLoader)
+    Model() : gammaCorrection(false), vertexFormat(VertexFormat::Full)
     {
-        for(unsigned int i = 0; i < meshes.size(); i++)
-            meshes[i].Draw(shader);
     }
 
-    void SetShaderTextureNamePrefix(std::string prefix) {
-        for (Mesh& mesh: meshes) {
-            mesh.glslIdentifierPrefix = prefix;
-        }
-    }
-private:
-    // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
-    void loadModel(string const &path)
+    // first loading phase: reads the model with ASSIMP and extracts vertices, indices and texture references.
+    // a binary mesh cache next to the file is used instead of ASSIMP when it is up to date, and (re)written otherwise.
+    // the meshes are uploaded with the given vertex layout, see VertexFormat.
+    // touches no OpenGL state, so it is safe to run on a worker thread.
+    void Import(string const &path, VertexFormat format = VertexFormat::Full)
     {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        // retrieve the directory path of the filepath
+        directory = path.substr(0, path.find_last_of('/'));
+        vertexFormat = format;
+        loadStat = {path, false, 0.0, 0.0, 0.0, MeshOptimizeStats()};
+
+        cache.reset(new MeshCache);
+        if (cache->open(path, format, lodLevels))
+        {
+            loadStat.fromCache = true;
+            loadStat.importMillis = millisecondsSince(start);
+            loadStat.assimpMillis = cache->importMillis();
+            return;
+        }
+        cache.reset();
+
         // read file via ASSIMP
         Assimp::Importer importer;
 
@@ -69,11 +104,255 @@ private:
             cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
             return;
         }
-        // retrieve the directory path of the filepath
-        directory = path.substr(0, path.find_last_of('/'));
 
         // process ASSIMP's root node recursively
         processNode(scene->mRootNode, scene);
+        // the optimized meshes are what gets cached, so warm starts get them for free
+        for (MeshData &data : imported)
+        {
+            addOptimizeStats(loadStat.optimize, optimizeMesh(data, lodLevels));
+            if (format == VertexFormat::Packed)
+                data.packedVertices = packVertices(data.vertices);
+        }
+
+        loadStat.importMillis = loadStat.assimpMillis = millisecondsSince(start);
+        if (!MeshCache::write(path, imported, format, lodLevels, loadStat.importMillis))
+            cout << "WARNING::MESH_CACHE:: could not write " << MeshCache::pathFor(path) << endl;
+    }
+
+    // second loading phase: loads the textures and uploads the imported meshes to the GPU.
+    // has to run on the thread that owns the GL context.
+    void Upload()
+    {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        vector<MeshBuffers> parts;
+        vector<vector<Texture>> partTextures;
+        if (cache)
+        {
+            // the meshes are uploaded straight from the mapped cache, the vertex and index data is never copied on the CPU
+            for (unsigned int i = 0; i < cache->meshCount(); i++)
+            {
+                parts.push_back(cache->buffers(i));
+                partTextures.push_back(cache->textures(i));
+            }
+        }
+        for (MeshData &data : imported)
+        {
+            parts.push_back(meshBuffers(data, vertexFormat));
+            partTextures.push_back(data.textures);
+        }
+        uploadShared(parts, partTextures);
+        if (retainCpuData)
+            for (size_t i = 0; i < imported.size(); i++)
+            {
+                Mesh &mesh = meshes[meshes.size() - imported.size() + i];
+                mesh.vertices = std::move(imported[i].vertices);
+                mesh.indices = std::move(imported[i].indices);
+                if (!mesh.lods.empty())
+                    mesh.indices.resize(mesh.lods[0].indexCount);
+            }
+        cache.reset();
+        vector<MeshData>().swap(imported); // everything not retained is freed here
+
+        loadStat.uploadMillis = millisecondsSince(start);
+        loadStat.cpuBytes = CpuBytes();
+        loadStat.lodLevelsRequested = lodLevels;
+        loadStat.lodLevelsBuilt = LodCount();
+        modelLoadStats().push_back(loadStat);
+    }
+
+    // draws the model, and thus all its meshes, at a level of detail
+    void Draw(Shader &shader, unsigned int lod = 0)
+    {
+        renderState().BindVertexArray(VAO);
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].DrawElements(shader, lod);
+    }
+
+    // draws count copies of the model with one call per mesh, the shader reads the model and normal matrix of each
+    // copy from the instance attributes (INSTANCE_MATRIX_ATTRIBUTE, INSTANCE_NORMAL_ATTRIBUTE) instead of its uniforms.
+    // fades, one per copy, dither copies in and out while they change their level of detail (see LodTransition),
+    // without them every copy is drawn whole
+    void DrawInstanced(Shader &shader, const WorldTransform *transforms, unsigned int count, unsigned int lod = 0,
+                       const float *fades = nullptr)
+    {
+        if (count == 0 || VAO == 0)
+            return;
+        // orphaned on every call, a model drawn several times a frame never waits on its previous instances
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glBufferData(GL_ARRAY_BUFFER, count * sizeof(WorldTransform), transforms, GL_STREAM_DRAW);
+        if (fades)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, instanceFadeVBO);
+            glBufferData(GL_ARRAY_BUFFER, count * sizeof(float), fades, GL_STREAM_DRAW);
+            zeroFades = 0;
+        }
+        else if (zeroFades < count)
+        {
+            // the zeros stay until fades are uploaded, most models never fade and upload them once
+            vector<float> zeros(count, 0.0f);
+            glBindBuffer(GL_ARRAY_BUFFER, instanceFadeVBO);
+            glBufferData(GL_ARRAY_BUFFER, count * sizeof(float), zeros.data(), GL_STREAM_DRAW);
+            zeroFades = count;
+        }
+        renderState().BindVertexArray(VAO);
+        for (Mesh &mesh : meshes)
+            mesh.DrawElementsInstanced(shader, count, lod);
+    }
+
+    void DrawInstanced(Shader &shader, const vector<WorldTransform> &transforms)
+    {
+        DrawInstanced(shader, transforms.data(), (unsigned int)transforms.size());
+    }
+
+    // levels of detail the meshes have, 1 when they only have their full level
+    unsigned int LodCount() const
+    {
+        return (unsigned int)max((size_t)1, lodErrors.size());
+    }
+
+    // triangles one copy of the model draws at a level of detail
+    unsigned int TriangleCount(unsigned int lod = 0) const
+    {
+        unsigned int triangles = 0;
+        for (const Mesh &mesh : meshes)
+            triangles += mesh.TriangleCount(lod);
+        return triangles;
+    }
+
+    // memory the model holds on the CPU, the meshes and the texture references
+    size_t CpuBytes() const
+    {
+        size_t bytes = sizeof(Model) + directory.capacity() + textures_loaded.capacity() * sizeof(Texture);
+        for (const Texture &texture : textures_loaded)
+            bytes += texture.type.capacity() + texture.path.capacity();
+        for (const Mesh &mesh : meshes)
+            bytes += mesh.CpuBytes();
+        return bytes + (meshes.capacity() - meshes.size()) * sizeof(Mesh);
+    }
+
+    // gives the model's texture references back to the registry, textures no other model uses are deleted
+    void ReleaseTextures()
+    {
+        for (const Texture &texture : textures_loaded)
+            textureRegistry().Release(texture.id);
+        textures_loaded.clear();
+    }
+
+    void SetShaderTextureNamePrefix(std::string prefix) {
+        for (Mesh& mesh: meshes) {
+            mesh.SetShaderTextureNamePrefix(prefix);
+        }
+    }
+
+    // bakes the sampler locations of all meshes for the shader the model is drawn with
+    void BindShader(const Shader &shader)
+    {
+        for (Mesh &mesh : meshes)
+            mesh.BindShader(shader);
+    }
+private:
+    // results of Import waiting for Upload, either a mapped mesh cache or meshes extracted by ASSIMP
+    unique_ptr<MeshCache> cache;
+    vector<MeshData> imported;
+    ModelLoadStat loadStat;
+    // instances the fade buffer holds zeros for, 0 while it holds real fades
+    unsigned int zeroFades = 0;
+
+    // puts all meshes into the model's VBO and EBO back to back, every mesh then draws its slice with a base vertex.
+    // the index block of every mesh starts 4 byte aligned, as meshes may mix 16 and 32 bit indices
+    void uploadShared(const vector<MeshBuffers> &parts, vector<vector<Texture>> &partTextures)
+    {
+        if (parts.empty())
+            return;
+        size_t vertexBytes = 0, indexBytes = 0;
+        for (const MeshBuffers &part : parts)
+        {
+            vertexBytes += part.vertexCount * vertexStride(vertexFormat);
+            indexBytes = alignIndexOffset(indexBytes) + part.indexCount * indexSize(part.indexType);
+        }
+
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, vertexBytes, nullptr, GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, nullptr, GL_STATIC_DRAW);
+        setupVertexAttributes(vertexFormat);
+
+        // plain draws fetch instance 0 of the instance attributes as well, so the buffer is never left empty
+        const WorldTransform identity;
+        glGenBuffers(1, &instanceVBO);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(WorldTransform), &identity, GL_STREAM_DRAW);
+        setupInstanceAttributes();
+        const float noFade = 0.0f;
+        glGenBuffers(1, &instanceFadeVBO);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceFadeVBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(float), &noFade, GL_STREAM_DRAW);
+        setupInstanceFadeAttribute();
+        zeroFades = 1;
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+
+        // imported meshes hand over their vectors after this, only cached ones need a copy to retain their data
+        bool copyCpuData = retainCpuData && cache != nullptr;
+        size_t indexOffset = 0;
+        unsigned int vertexOffset = 0;
+        for (size_t i = 0; i < parts.size(); i++)
+        {
+            const MeshBuffers &part = parts[i];
+            indexOffset = alignIndexOffset(indexOffset);
+            glBufferSubData(GL_ARRAY_BUFFER, vertexOffset * vertexStride(vertexFormat), part.vertexCount * vertexStride(vertexFormat), part.vertices);
+            glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, indexOffset, part.indexCount * indexSize(part.indexType), part.indices);
+            meshes.push_back(Mesh(part, loadTextures(std::move(partTextures[i])), VAO, indexOffset, (int)vertexOffset,
+                                  copyCpuData));
+            indexOffset += part.indexCount * indexSize(part.indexType);
+            vertexOffset += part.vertexCount;
+            bounds = i == 0 ? part.bounds : mergeBounds(bounds, part.bounds);
+            // a mesh with fewer levels draws its last one for the levels it lacks
+            lodErrors.resize(max(lodErrors.size(), max((size_t)1, part.lods.size())), 0.0f);
+        }
+        for (unsigned int level = 1; level < lodErrors.size(); level++)
+            for (const Mesh &mesh : meshes)
+                if (!mesh.lods.empty())
+                    lodErrors[level] = max(lodErrors[level], mesh.lods[min(level, (unsigned int)mesh.lods.size() - 1)].error);
+        glBindVertexArray(0);
+    }
+
+    static size_t alignIndexOffset(size_t offset)
+    {
+        return (offset + 3) & ~(size_t)3;
+    }
+
+    // accumulates per mesh optimizer results into model wide ones, the ratios weighted by triangles and vertices
+    static void addOptimizeStats(MeshOptimizeStats &total, const MeshOptimizeStats &mesh)
+    {
+        unsigned int triangles = total.triangles + mesh.triangles;
+        unsigned int vertices = total.verticesAfter + mesh.verticesAfter;
+        if (triangles == 0 || vertices == 0)
+            return;
+        auto blend = [](float a, unsigned int weightA, float b, unsigned int weightB) { return (a * weightA + b * weightB) / (weightA + weightB); };
+        total.before.acmr = blend(total.before.acmr, total.triangles, mesh.before.acmr, mesh.triangles);
+        total.after.acmr = blend(total.after.acmr, total.triangles, mesh.after.acmr, mesh.triangles);
+        total.before.atvr = blend(total.before.atvr, total.verticesAfter, mesh.before.atvr, mesh.verticesAfter);
+        total.after.atvr = blend(total.after.atvr, total.verticesAfter, mesh.after.atvr, mesh.verticesAfter);
+        total.triangles = triangles;
+        total.verticesBefore += mesh.verticesBefore;
+        total.indexBytesBefore += mesh.indexBytesBefore;
+        total.indexBytesAfter += mesh.indexBytesAfter;
+        for (unsigned int level = 0; level < MAX_LOD_LEVELS; level++)
+            total.lodTriangles[level] += mesh.lodTriangles[level];
+        total.verticesAfter = vertices;
+    }
+
+    // resolves the texture references of an imported mesh to GL textures
+    vector<Texture> loadTextures(vector<Texture> textures)
+    {
+        for (Texture &texture : textures)
+            texture = loadTexture(texture.path.c_str(), texture.type);
+        return textures;
     }
 
     // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
@@ -85,7 +364,7 @@ private:
             // the node object only contains indices to index the actual objects in the scene.
             // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
             aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            imported.push_back(processMesh(mesh, scene));
         }
         // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
         for(unsigned int i = 0; i < node->mNumChildren; i++)
@@ -95,12 +374,13 @@ private:
 
     }
 
-    Mesh processMesh(aiMesh *mesh, const aiScene *scene)
+    MeshData processMesh(aiMesh *mesh, const aiScene *scene)
     {
         // data to fill
-        vector<Vertex> vertices;
-        vector<unsigned int> indices;
-        vector<Texture> textures;
+        MeshData data;
+        vector<Vertex> &vertices = data.vertices;
+        vector<unsigned int> &indices = data.indices;
+        vector<Texture> &textures = data.textures;
 
         // walk through each of the mesh's vertices
         for(unsigned int i = 0; i < mesh->mNumVertices; i++)
@@ -180,13 +460,14 @@ private:
         std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
         textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
 
+        // bounding box and sphere for culling, stored in the mesh cache along with the vertices
+        data.bounds = computeBounds(vertices);
 
-
-        // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        // return the extracted mesh data, it is turned into a Mesh on upload
+        return data;
     }
 
-    // checks all material textures of a given type and loads the textures if they're not loaded yet.
+    // collects all material textures of a given type, the textures themselves are loaded on upload.
     // the required info is returned as a Texture struct.
     vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName)
     {
@@ -195,29 +476,27 @@ private:
         {
             aiString str;
             mat->GetTexture(type, i, &str);
-            // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-            for(unsigned int j = 0; j < textures_loaded.size(); j++)
-            {
-                if(std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-                {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
-                }
-            }
-            if(!skip)
-            {   // if texture hasn't been loaded already, load it
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
-            }
+            Texture texture;
+            texture.id = 0;
+            texture.type = typeName;
+            texture.role = textureRole(typeName);
+            texture.path = str.C_Str();
+            textures.push_back(texture);
         }
         return textures;
     }
+
+    // loads a single texture of the model, the registry makes sure a file shared with other models is loaded only once
+    Texture loadTexture(const char *path, const string &typeName)
+    {
+        Texture texture;
+        texture.id = TextureFromFile(path, this->directory);
+        texture.type = typeName;
+        texture.role = textureRole(typeName);
+        texture.path = path;
+        textures_loaded.push_back(texture);  // remember the reference so ReleaseTextures can give it back
+        return texture;
+    }
 };
 
 
@@ -226,38 +505,8 @@ unsigned int TextureFromFile(const char *path, const string &directory, bool gam
     string filename = string(path);
     filename = directory + '/' + filename;
 
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
+    // shared through the registry and decoded in the background, the returned texture shows a placeholder
+    // until the image has been streamed in
+    return textureRegistry().Acquire2D(filename);
 }
 #endif
@@ -0,0 +1,55 @@
+#ifndef MODEL_LOADER_H
+#define MODEL_LOADER_H
+
+#include <learnopengl/model.h>
+#include <learnopengl/thread_pool.h>
+
+#include <chrono>
+#include <future>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// loads several models at once: the CPU heavy import of every model runs on the worker pool,
+// while the GPU uploads are done by whoever calls Finish, which has to be the GL thread.
+class ModelLoader
+{
+public:
+    explicit ModelLoader(ThreadPool &pool = workerPool()) : pool(pool), start(chrono::steady_clock::now())
+    {
+    }
+
+    // starts importing path into model right away, the model must stay alive until Finish returns
+    void Add(Model &model, const string &path, VertexFormat format = VertexFormat::Full)
+    {
+        Model *target = &model;
+        pending.push_back({target, pool.enqueue([target, path, format]() { target->Import(path, format); })});
+    }
+
+    // uploads the models in the order they were added, each one as soon as its import is done,
+    // so the uploads overlap with the imports still running. Returns the wall time since construction.
+    double Finish()
+    {
+        for (Pending &job : pending)
+        {
+            job.import.get();
+            job.model->Upload();
+        }
+        pending.clear();
+        return millisecondsSince(start);
+    }
+
+    unsigned int ThreadCount() const { return pool.threadCount(); }
+
+private:
+    struct Pending {
+        Model *model;
+        future<void> import;
+    };
+
+    ThreadPool &pool;
+    vector<Pending> pending;
+    chrono::steady_clock::time_point start;
+};
+#endif
@@ -0,0 +1,266 @@
+#ifndef OCCLUSION_CULLING_H
+#define OCCLUSION_CULLING_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/frustum_culling.h>
+#include <learnopengl/render_state.h>
+#include <learnopengl/shader_m.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+static_assert(sizeof(Aabb) == 24, "the boxes are read as two vec3 vertex attributes");
+
+// Occlusion culling against a hierarchical depth buffer, with GL 3.3 and no compute shaders.
+//
+// Test runs in the middle of a frame, once the occluders are drawn: it copies the depth buffer into the base of
+// a mipmapped depth texture and builds every smaller level with the farthest depth of the texels below it. One
+// point per box then projects the box, picks the level where its screen rectangle spans at most 2x2 texels and
+// compares the box's nearest depth with the farthest of those four; the answer lands in one texel per box,
+// which is read back through a pixel buffer. Collect picks it up on a later frame once the GPU is done, so the
+// results are a frame old and nothing ever waits. A box drawn again shows up one frame late at worst.
+//
+// Needs a current GL context when constructed; the shaders are resources/shaders/hiz_downsample and hiz_test.
+class OcclusionCuller
+{
+public:
+    OcclusionCuller(Shader &downsampleShader, Shader &testShader)
+        : downsampleShader(downsampleShader), testShader(testShader)
+    {
+        downsampleShader.use();
+        downsampleShader.setInt("depth", 0);
+        previousSizeUniform = downsampleShader.uniform("previousSize");
+        testShader.use();
+        testShader.setInt("hiZ", 0);
+        viewProjectionUniform = testShader.uniform("viewProjection");
+        depthSizeUniform = testShader.uniform("depthSize");
+        maxLevelUniform = testShader.uniform("maxLevel");
+        resultsSizeUniform = testShader.uniform("resultsSize");
+
+        glGenFramebuffers(1, &pyramidFBO);
+        glGenFramebuffers(1, &resultsFBO);
+        glGenVertexArrays(1, &emptyVAO);
+        glGenVertexArrays(1, &boxVAO);
+        glGenBuffers(1, &boxVBO);
+        glGenBuffers(1, &readbackPBO);
+        glBindVertexArray(boxVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, boxVBO);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Aabb), (void*)offsetof(Aabb, min));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Aabb), (void*)offsetof(Aabb, max));
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        renderState().Invalidate();
+    }
+
+    OcclusionCuller(const OcclusionCuller &) = delete;
+    OcclusionCuller &operator=(const OcclusionCuller &) = delete;
+
+    // forgets the results, for when the boxes are numbered differently
+    void Reset()
+    {
+        occluded.clear();
+        deleteFence();
+    }
+
+    // takes over the results of the last Test if the GPU has finished it, never waits for it
+    void Collect()
+    {
+        if (!fence)
+            return;
+        GLenum status = glClientWaitSync(fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            return;
+        deleteFence();
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackPBO);
+        const uint8_t *texels = (const uint8_t*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, pendingCount, GL_MAP_READ_BIT);
+        if (texels)
+        {
+            occluded.resize(pendingCount);
+            for (unsigned int i = 0; i < pendingCount; i++)
+                occluded[i] = texels[i] == 0 ? 1 : 0;
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    // as of the last collected Test, boxes it did not cover count as visible
+    bool Occluded(unsigned int box) const
+    {
+        return box < occluded.size() && occluded[box] != 0;
+    }
+
+    // builds the pyramid from the depth buffer of the default framebuffer, which is width x height, and tests the
+    // boxes against it. Leaves framebuffer 0 bound with the full viewport; a Test whose results were not collected
+    // yet is not repeated
+    void Test(const vector<Aabb> &boxes, const glm::mat4 &viewProjection, int width, int height)
+    {
+        if (fence || boxes.empty() || width <= 0 || height <= 0)
+            return;
+        resize(width, height);
+        renderState().BindTexture(0, GL_TEXTURE_2D, depthPyramid);
+        glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, width, height);
+        buildPyramid();
+        testBoxes(boxes, viewProjection);
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackPBO);
+        glReadPixels(0, 0, RESULTS_WIDTH, resultsRows, GL_RED, GL_UNSIGNED_BYTE, 0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        pendingCount = (unsigned int)boxes.size();
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, width, height);
+    }
+
+    // deletes the textures, buffers and framebuffers, called at shutdown while the context still exists
+    void Release()
+    {
+        deleteFence();
+        renderState().ForgetTexture(depthPyramid);
+        renderState().ForgetTexture(resultsTexture);
+        glDeleteTextures(1, &depthPyramid);
+        glDeleteTextures(1, &resultsTexture);
+        glDeleteFramebuffers(1, &pyramidFBO);
+        glDeleteFramebuffers(1, &resultsFBO);
+        glDeleteVertexArrays(1, &emptyVAO);
+        glDeleteVertexArrays(1, &boxVAO);
+        glDeleteBuffers(1, &boxVBO);
+        glDeleteBuffers(1, &readbackPBO);
+        depthPyramid = resultsTexture = pyramidFBO = resultsFBO = emptyVAO = boxVAO = boxVBO = readbackPBO = 0;
+        renderState().Invalidate();
+    }
+
+private:
+    // boxes per row of the results texture
+    static const int RESULTS_WIDTH = 256;
+
+    Shader &downsampleShader;
+    Shader &testShader;
+    Uniform previousSizeUniform, viewProjectionUniform, depthSizeUniform, maxLevelUniform, resultsSizeUniform;
+
+    unsigned int depthPyramid = 0, pyramidFBO = 0, emptyVAO = 0;
+    vector<glm::ivec2> levelSizes;
+    unsigned int resultsTexture = 0, resultsFBO = 0, boxVAO = 0, boxVBO = 0, readbackPBO = 0;
+    int resultsRows = 0;
+
+    GLsync fence = 0;
+    unsigned int pendingCount = 0;
+    vector<uint8_t> occluded;
+
+    void deleteFence()
+    {
+        if (fence)
+            glDeleteSync(fence);
+        fence = 0;
+    }
+
+    // (re)allocates the pyramid for a new framebuffer size, every level down to 1x1
+    void resize(int width, int height)
+    {
+        if (!levelSizes.empty() && levelSizes[0] == glm::ivec2(width, height))
+            return;
+        levelSizes.clear();
+        glm::ivec2 size(width, height);
+        levelSizes.push_back(size);
+        while (size.x > 1 || size.y > 1)
+        {
+            size = glm::ivec2(std::max(size.x / 2, 1), std::max(size.y / 2, 1));
+            levelSizes.push_back(size);
+        }
+        if (depthPyramid)
+        {
+            renderState().ForgetTexture(depthPyramid);
+            glDeleteTextures(1, &depthPyramid);
+        }
+        glGenTextures(1, &depthPyramid);
+        renderState().BindTexture(0, GL_TEXTURE_2D, depthPyramid);
+        for (unsigned int level = 0; level < levelSizes.size(); level++)
+            glTexImage2D(GL_TEXTURE_2D, level, GL_DEPTH_COMPONENT24, levelSizes[level].x, levelSizes[level].y, 0,
+                         GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)levelSizes.size() - 1);
+        glBindFramebuffer(GL_FRAMEBUFFER, pyramidFBO);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // each level from the one above it, which is made the texture's only level meanwhile so the pass does not
+    // read what it writes
+    void buildPyramid()
+    {
+        downsampleShader.use();
+        renderState().BindTexture(0, GL_TEXTURE_2D, depthPyramid);
+        renderState().BindVertexArray(emptyVAO);
+        renderState().Enable(GL_DEPTH_TEST);
+        renderState().DepthFunc(GL_ALWAYS);
+        renderState().DepthMask(true);
+        glBindFramebuffer(GL_FRAMEBUFFER, pyramidFBO);
+        for (unsigned int level = 1; level < levelSizes.size(); level++)
+        {
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, (GLint)level - 1);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)level - 1);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthPyramid, level);
+            glViewport(0, 0, levelSizes[level].x, levelSizes[level].y);
+            downsampleShader.setVec2(previousSizeUniform, glm::vec2(levelSizes[level - 1]));
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)levelSizes.size() - 1);
+    }
+
+    void testBoxes(const vector<Aabb> &boxes, const glm::mat4 &viewProjection)
+    {
+        int rows = ((int)boxes.size() + RESULTS_WIDTH - 1) / RESULTS_WIDTH;
+        if (rows > resultsRows)
+        {
+            if (resultsTexture)
+            {
+                renderState().ForgetTexture(resultsTexture);
+                glDeleteTextures(1, &resultsTexture);
+            }
+            resultsRows = rows;
+            glGenTextures(1, &resultsTexture);
+            renderState().BindTexture(0, GL_TEXTURE_2D, resultsTexture);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, RESULTS_WIDTH, resultsRows, 0, GL_RED, GL_UNSIGNED_BYTE, nullptr);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glBindFramebuffer(GL_FRAMEBUFFER, resultsFBO);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, resultsTexture, 0);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackPBO);
+            glBufferData(GL_PIXEL_PACK_BUFFER, RESULTS_WIDTH * resultsRows, nullptr, GL_STREAM_READ);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        }
+
+        glBindBuffer(GL_ARRAY_BUFFER, boxVBO);
+        glBufferData(GL_ARRAY_BUFFER, boxes.size() * sizeof(Aabb), boxes.data(), GL_STREAM_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, resultsFBO);
+        glViewport(0, 0, RESULTS_WIDTH, resultsRows);
+        renderState().Disable(GL_DEPTH_TEST);
+        renderState().Disable(GL_BLEND);
+        testShader.use();
+        testShader.setMat4(viewProjectionUniform, viewProjection);
+        testShader.setVec2(depthSizeUniform, glm::vec2(levelSizes[0]));
+        testShader.setInt(maxLevelUniform, (int)levelSizes.size() - 1);
+        testShader.setVec2(resultsSizeUniform, glm::vec2(RESULTS_WIDTH, resultsRows));
+        renderState().BindTexture(0, GL_TEXTURE_2D, depthPyramid);
+        renderState().BindVertexArray(boxVAO);
+        glDrawArrays(GL_POINTS, 0, (GLsizei)boxes.size());
+        renderState().Enable(GL_DEPTH_TEST);
+        renderState().Enable(GL_BLEND);
+    }
+};
+#endif
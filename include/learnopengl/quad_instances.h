@@ -0,0 +1,106 @@
+#ifndef QUAD_INSTANCES_H
+#define QUAD_INSTANCES_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <cstddef>
+#include <random>
+#include <vector>
+
+using namespace std;
+
+// attribute locations of the per-instance quad parameters, after position (0) and texture coords (1) of the quad
+#define QUAD_INSTANCE_ATTRIBUTE 2
+
+// Placement of one textured quad (a grass card, a waterfall tile). The vertex shader builds the model matrix
+// translate(position) * rotateY(yaw) * scale(scale) * rotateX(pitch) from it, angles in radians.
+struct QuadInstance {
+    glm::vec3 position;
+    float yaw;
+    float pitch;
+    float scale;
+};
+
+static_assert(sizeof(QuadInstance) == 24, "QuadInstance is read as a vec4 and a vec2 per instance");
+
+// Holds the instances of a quad in a buffer wired to the given VAO, so all of them draw with one
+// glDrawArraysInstanced or glDrawElementsInstanced call. Needs a current GL context when constructed.
+class QuadInstanceBuffer
+{
+public:
+    explicit QuadInstanceBuffer(unsigned int VAO)
+    {
+        glGenBuffers(1, &VBO);
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        // xyz position, w yaw
+        glEnableVertexAttribArray(QUAD_INSTANCE_ATTRIBUTE);
+        glVertexAttribPointer(QUAD_INSTANCE_ATTRIBUTE, 4, GL_FLOAT, GL_FALSE, sizeof(QuadInstance), (void*)offsetof(QuadInstance, position));
+        glVertexAttribDivisor(QUAD_INSTANCE_ATTRIBUTE, 1);
+        // x pitch, y scale
+        glEnableVertexAttribArray(QUAD_INSTANCE_ATTRIBUTE + 1);
+        glVertexAttribPointer(QUAD_INSTANCE_ATTRIBUTE + 1, 2, GL_FLOAT, GL_FALSE, sizeof(QuadInstance), (void*)offsetof(QuadInstance, pitch));
+        glVertexAttribDivisor(QUAD_INSTANCE_ATTRIBUTE + 1, 1);
+        glBindVertexArray(0);
+    }
+
+    QuadInstanceBuffer(const QuadInstanceBuffer &) = delete;
+    QuadInstanceBuffer &operator=(const QuadInstanceBuffer &) = delete;
+
+    // replaces all instances, meant for placements that change rarely (a new density, not every frame)
+    void Upload(const vector<QuadInstance> &instances)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(QuadInstance), instances.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        count = (unsigned int)instances.size();
+    }
+
+    unsigned int Count() const { return count; }
+
+    // deletes the buffer, called at shutdown while the context still exists
+    void Release()
+    {
+        glDeleteBuffers(1, &VBO);
+        VBO = 0;
+        count = 0;
+    }
+
+private:
+    unsigned int VBO = 0;
+    unsigned int count = 0;
+};
+
+// Grows every anchor into a cluster of density quads scattered within radius around it, each with a random yaw and
+// a scale between 0.7 and 1.1 of the anchor's. A density of 1 returns the anchors unchanged. The seed keeps the
+// layout the same from run to run.
+inline vector<QuadInstance> scatterQuads(const vector<QuadInstance> &anchors, unsigned int density, float radius,
+                                         unsigned int seed = 1)
+{
+    if (density <= 1)
+        return anchors;
+    mt19937 random(seed);
+    uniform_real_distribution<float> unit(0.0f, 1.0f);
+    const float twoPi = 6.28318530718f;
+    vector<QuadInstance> quads;
+    quads.reserve(anchors.size() * density);
+    for (const QuadInstance &anchor : anchors)
+    {
+        quads.push_back(anchor);
+        for (unsigned int i = 1; i < density; i++)
+        {
+            // uniform over the disc, sqrt keeps the center from getting denser than the rim
+            float distance = radius * sqrt(unit(random));
+            float angle = twoPi * unit(random);
+            QuadInstance quad = anchor;
+            quad.position += glm::vec3(cos(angle) * distance, 0.0f, sin(angle) * distance);
+            quad.yaw = twoPi * unit(random);
+            quad.scale = anchor.scale * (0.7f + 0.4f * unit(random));
+            quads.push_back(quad);
+        }
+    }
+    return quads;
+}
+#endif
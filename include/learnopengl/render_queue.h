@@ -0,0 +1,277 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <learnopengl/model.h>
+#include <learnopengl/render_state.h>
+#include <learnopengl/shader_m.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// passes run in this order, the sky goes before the transparent pass so blended surfaces show it through them.
+// The geometry pass fills the G-buffer of the deferred path (see deferred_renderer.h) ahead of everything else
+enum class RenderPass : uint8_t { Geometry, Opaque, Cutout, Sky, Transparent };
+
+// the transform uniforms of a program, resolved once with transformUniforms
+struct TransformUniforms {
+    Uniform model;
+    Uniform normal;
+    Uniform instanced;  // the bool that switches the program to the instance attributes
+};
+
+inline TransformUniforms transformUniforms(const Shader &shader)
+{
+    return {shader.uniform("model"), shader.uniform("normalMatrix"), shader.uniform("instanced")};
+}
+
+// One draw of the frame. Drawn either as a Model or as a plain vertex array with a single texture in unit 0,
+// both instanced when instanceCount is set
+struct RenderCommand {
+    Shader *shader;
+    Uniform modelUniform;
+    glm::mat4 model;
+    Uniform normalUniform;
+    glm::mat3 normal;
+    Uniform instancedUniform;
+    Model *object = nullptr;
+    unsigned int firstInstance = 0;   // into the queue's instance transforms, for models
+    unsigned int instanceCount = 0;
+    unsigned int lod = 0;             // level of detail of the model
+    bool faded = false;               // the instances carry level of detail fades in the queue's instance fades
+    unsigned int VAO = 0;
+    GLenum textureTarget = GL_TEXTURE_2D;
+    unsigned int texture = 0;
+    GLenum mode = GL_TRIANGLES;
+    GLsizei count = 0;
+    bool indexed = false;
+};
+
+// Collects the draws of a frame and executes them sorted by a 64-bit key. The pass sits in the top 4 bits.
+// Within the opaque, cutout and sky passes the key continues with the program, the texture set and the depth,
+// so draws sharing a program and textures run back to back and nearer ones go first. The transparent pass
+// puts the inverted depth right after the pass, which gives back to front order regardless of program.
+class RenderQueue
+{
+public:
+    // the camera position the depths are measured from and the far plane they are scaled by
+    void Begin(const glm::vec3 &cameraPosition, float farPlane)
+    {
+        commands.clear();
+        keys.clear();
+        instances.clear();
+        instanceFades.clear();
+        this->cameraPosition = cameraPosition;
+        this->farPlane = farPlane;
+    }
+
+    void DrawModel(RenderPass pass, Shader &shader, const TransformUniforms &uniforms, const WorldTransform &transform, Model &object)
+    {
+        RenderCommand command;
+        command.shader = &shader;
+        command.modelUniform = uniforms.model;
+        command.model = transform.model;
+        command.normalUniform = uniforms.normal;
+        command.normal = transform.normal;
+        command.object = &object;
+        // models are grouped by their first texture, meshes of one model mostly share their textures anyway
+        submit(pass, command, object.textures_loaded.empty() ? 0 : object.textures_loaded.front().id);
+    }
+
+    // draws the model once per transform with a single instanced call per mesh. The program has to read the model
+    // and normal matrix from the instance attributes while its bool uniform "instanced" is set, the queue sets it around the draw.
+    // lod picks the level of detail, fades (one per transform, see LodTransition) dither the instances in and out
+    void DrawModelInstanced(RenderPass pass, Shader &shader, const TransformUniforms &uniforms, const vector<WorldTransform> &transforms,
+                            Model &object, unsigned int lod = 0, const vector<float> *fades = nullptr)
+    {
+        if (transforms.empty())
+            return;
+        RenderCommand command;
+        command.shader = &shader;
+        command.instancedUniform = uniforms.instanced;
+        command.model = transforms.front().model;
+        command.object = &object;
+        command.firstInstance = (unsigned int)instances.size();
+        command.instanceCount = (unsigned int)transforms.size();
+        command.lod = lod;
+        command.faded = fades != nullptr;
+        instances.insert(instances.end(), transforms.begin(), transforms.end());
+        if (fades)
+        {
+            instanceFades.resize(command.firstInstance, 0.0f);
+            instanceFades.insert(instanceFades.end(), fades->begin(), fades->begin() + transforms.size());
+        }
+        submit(pass, command, object.textures_loaded.empty() ? 0 : object.textures_loaded.front().id);
+    }
+
+    void DrawArrays(RenderPass pass, Shader &shader, Uniform modelUniform, const glm::mat4 &model, unsigned int VAO,
+                    GLenum textureTarget, unsigned int texture, GLsizei count)
+    {
+        submit(pass, vertexArrayCommand(shader, modelUniform, model, VAO, textureTarget, texture, count, false), texture);
+    }
+
+    // draws count unsigned int indices from the start of the vertex array's element buffer
+    void DrawElements(RenderPass pass, Shader &shader, Uniform modelUniform, const glm::mat4 &model, unsigned int VAO,
+                      GLenum textureTarget, unsigned int texture, GLsizei count)
+    {
+        submit(pass, vertexArrayCommand(shader, modelUniform, model, VAO, textureTarget, texture, count, true), texture);
+    }
+
+    // instanced draws of a vertex array that carries its own instance attributes (see QuadInstanceBuffer),
+    // center is where the instances are, for the depth of the sort key
+    void DrawArraysInstanced(RenderPass pass, Shader &shader, const glm::vec3 &center, unsigned int VAO,
+                             GLenum textureTarget, unsigned int texture, GLsizei count, unsigned int instanceCount)
+    {
+        submitInstanced(pass, vertexArrayCommand(shader, Uniform(), glm::translate(glm::mat4(1.0f), center), VAO,
+                                                 textureTarget, texture, count, false), instanceCount);
+    }
+
+    void DrawElementsInstanced(RenderPass pass, Shader &shader, const glm::vec3 &center, unsigned int VAO,
+                               GLenum textureTarget, unsigned int texture, GLsizei count, unsigned int instanceCount)
+    {
+        submitInstanced(pass, vertexArrayCommand(shader, Uniform(), glm::translate(glm::mat4(1.0f), center), VAO,
+                                                 textureTarget, texture, count, true), instanceCount);
+    }
+
+    // sorts the commands and draws them, switching the per-pass depth state on the way
+    void Execute()
+    {
+        Execute([](RenderPass) {});
+    }
+
+    // the same, calling beforePass(pass) ahead of every pass whether it has commands or not, so work that needs
+    // the frame drawn up to a point (the depth of the opaque passes) can run there. It may change any GL state
+    // it leaves the tracker informed of
+    template<class BeforePass>
+    void Execute(BeforePass beforePass)
+    {
+        sort(keys.begin(), keys.end());
+        int currentPass = -1;
+        for (const pair<uint64_t, unsigned int> &key : keys)
+        {
+            int pass = (int)(key.first >> PASS_SHIFT);
+            while (currentPass < pass)
+            {
+                beforePass((RenderPass)++currentPass);
+                beginPass((RenderPass)currentPass);
+            }
+            execute(commands[key.second]);
+        }
+        while (currentPass < (int)RenderPass::Transparent)
+            beforePass((RenderPass)++currentPass);
+        beginPass(RenderPass::Opaque);
+    }
+
+    unsigned int Size() const { return (unsigned int)commands.size(); }
+
+private:
+    static const int PASS_SHIFT = 60;
+    static const uint64_t SHADER_BITS = 12, MATERIAL_BITS = 20, DEPTH_BITS = 24;
+
+    vector<RenderCommand> commands;
+    vector<pair<uint64_t, unsigned int>> keys;   // sort key and index into commands
+    vector<WorldTransform> instances;
+    vector<float> instanceFades;                 // parallel to instances up to the last faded command
+    glm::vec3 cameraPosition = glm::vec3(0.0f);
+    float farPlane = 100.0f;
+
+    static uint64_t bits(uint64_t value, uint64_t count)
+    {
+        return value & ((1ull << count) - 1);
+    }
+
+    uint64_t quantizedDepth(const glm::mat4 &model) const
+    {
+        float depth = glm::length(glm::vec3(model[3]) - cameraPosition) / farPlane;
+        depth = std::min(std::max(depth, 0.0f), 1.0f);
+        return (uint64_t)(depth * (float)((1ull << DEPTH_BITS) - 1));
+    }
+
+    void submit(RenderPass pass, const RenderCommand &command, unsigned int material)
+    {
+        uint64_t shader = bits(command.shader->ID, SHADER_BITS);
+        uint64_t depth = quantizedDepth(command.model);
+        uint64_t key = (uint64_t)pass << PASS_SHIFT;
+        if (pass == RenderPass::Transparent)
+            key |= bits(~depth, DEPTH_BITS) << (PASS_SHIFT - DEPTH_BITS)
+                   | shader << (PASS_SHIFT - DEPTH_BITS - SHADER_BITS)
+                   | bits(material, MATERIAL_BITS) << (PASS_SHIFT - DEPTH_BITS - SHADER_BITS - MATERIAL_BITS);
+        else
+            key |= shader << (PASS_SHIFT - SHADER_BITS)
+                   | bits(material, MATERIAL_BITS) << (PASS_SHIFT - SHADER_BITS - MATERIAL_BITS)
+                   | depth << (PASS_SHIFT - SHADER_BITS - MATERIAL_BITS - DEPTH_BITS);
+        keys.push_back(make_pair(key, (unsigned int)commands.size()));
+        commands.push_back(command);
+    }
+
+    void submitInstanced(RenderPass pass, RenderCommand command, unsigned int instanceCount)
+    {
+        if (instanceCount == 0)
+            return;
+        command.instanceCount = instanceCount;
+        submit(pass, command, command.texture);
+    }
+
+    static RenderCommand vertexArrayCommand(Shader &shader, Uniform modelUniform, const glm::mat4 &model, unsigned int VAO,
+                                            GLenum textureTarget, unsigned int texture, GLsizei count, bool indexed)
+    {
+        RenderCommand command;
+        command.shader = &shader;
+        command.modelUniform = modelUniform;
+        command.model = model;
+        command.VAO = VAO;
+        command.textureTarget = textureTarget;
+        command.texture = texture;
+        command.count = count;
+        command.indexed = indexed;
+        return command;
+    }
+
+    static void beginPass(RenderPass pass)
+    {
+        // the sky is drawn at the far plane behind everything, it must pass the depth test there without writing
+        bool sky = pass == RenderPass::Sky;
+        renderState().DepthMask(!sky);
+        renderState().DepthFunc(sky ? GL_LEQUAL : GL_LESS);
+    }
+
+    void execute(const RenderCommand &command)
+    {
+        command.shader->use();
+        if (command.modelUniform.valid())
+            command.shader->setMat4(command.modelUniform, command.model);
+        if (command.normalUniform.valid())
+            command.shader->setMat3(command.normalUniform, command.normal);
+        if (command.object && command.instanceCount > 0)
+        {
+            command.shader->setBool(command.instancedUniform, true);
+            command.object->DrawInstanced(*command.shader, &instances[command.firstInstance], command.instanceCount, command.lod,
+                                          command.faded ? &instanceFades[command.firstInstance] : nullptr);
+            command.shader->setBool(command.instancedUniform, false);
+            return;
+        }
+        if (command.object)
+        {
+            command.object->Draw(*command.shader);
+            return;
+        }
+        renderState().BindVertexArray(command.VAO);
+        renderState().BindTexture(0, command.textureTarget, command.texture);
+        if (command.instanceCount > 0 && command.indexed)
+            glDrawElementsInstanced(command.mode, command.count, GL_UNSIGNED_INT, 0, command.instanceCount);
+        else if (command.instanceCount > 0)
+            glDrawArraysInstanced(command.mode, 0, command.count, command.instanceCount);
+        else if (command.indexed)
+            glDrawElements(command.mode, command.count, GL_UNSIGNED_INT, 0);
+        else
+            glDrawArrays(command.mode, 0, command.count);
+    }
+};
+#endif
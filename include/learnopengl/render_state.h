@@ -0,0 +1,184 @@
+#ifndef RENDER_STATE_H
+#define RENDER_STATE_H
+
+#include <glad/glad.h>
+
+// Remembers the GL state that was last set through it and drops calls that would not change anything.
+// Everything that binds programs, vertex arrays or textures while the render loop runs goes through here;
+// code that changes that state behind its back has to call Invalidate afterwards.
+class RenderState
+{
+public:
+    static const unsigned int MAX_TEXTURE_UNITS = 16;
+
+    RenderState()
+    {
+        Invalidate();
+    }
+
+    RenderState(const RenderState &) = delete;
+    RenderState &operator=(const RenderState &) = delete;
+
+    // forgets all state, the next call of each kind reaches GL again
+    void Invalidate()
+    {
+        program = vertexArray = UNKNOWN;
+        activeUnit = UNKNOWN;
+        for (unsigned int unit = 0; unit < MAX_TEXTURE_UNITS; unit++)
+            textures[unit][0] = textures[unit][1] = UNKNOWN;
+        depthTest = blend = cullFace = depthClamp = depthMask = -1;
+        depthFunc = cullMode = blendSource = blendDestination = UNKNOWN;
+    }
+
+    // starts counting a new frame, the counts of the finished one stay readable until the next call
+    void BeginFrame()
+    {
+        lastIssued = issued;
+        lastFiltered = filtered;
+        issued = filtered = 0;
+    }
+
+    // state calls that reached GL and that were dropped as redundant during the last frame
+    unsigned int IssuedCalls() const { return lastIssued; }
+    unsigned int FilteredCalls() const { return lastFiltered; }
+
+    void UseProgram(GLuint id)
+    {
+        if (changes(program, id))
+            glUseProgram(id);
+    }
+
+    void BindVertexArray(GLuint id)
+    {
+        if (changes(vertexArray, id))
+            glBindVertexArray(id);
+    }
+
+    void ActiveTexture(unsigned int unit)
+    {
+        if (changes(activeUnit, unit))
+            glActiveTexture(GL_TEXTURE0 + unit);
+    }
+
+    void BindTexture(unsigned int unit, GLenum target, GLuint id)
+    {
+        int slot = targetSlot(target);
+        if (unit >= MAX_TEXTURE_UNITS || slot < 0)
+        {
+            ActiveTexture(unit);
+            glBindTexture(target, id);
+            issued++;
+            return;
+        }
+        if (textures[unit][slot] == id)
+        {
+            filtered++;
+            return;
+        }
+        ActiveTexture(unit);
+        textures[unit][slot] = id;
+        glBindTexture(target, id);
+        issued++;
+    }
+
+    // binds to whatever unit is active, for code that only needs a texture bound to modify it
+    void BindTexture(GLenum target, GLuint id)
+    {
+        if (activeUnit == UNKNOWN)
+            ActiveTexture(0);
+        BindTexture(activeUnit, target, id);
+    }
+
+    // a deleted texture name can come back from glGenTextures, so bindings to it must not be trusted anymore
+    void ForgetTexture(GLuint id)
+    {
+        for (unsigned int unit = 0; unit < MAX_TEXTURE_UNITS; unit++)
+            for (GLuint &bound : textures[unit])
+                if (bound == id)
+                    bound = UNKNOWN;
+    }
+
+    // GL_DEPTH_TEST, GL_BLEND, GL_CULL_FACE and GL_DEPTH_CLAMP are tracked, other capabilities are passed through
+    void Enable(GLenum capability) { setCapability(capability, true); }
+    void Disable(GLenum capability) { setCapability(capability, false); }
+
+    void DepthMask(bool write)
+    {
+        if (changes(depthMask, write ? 1 : 0))
+            glDepthMask(write ? GL_TRUE : GL_FALSE);
+    }
+
+    void DepthFunc(GLenum func)
+    {
+        if (changes(depthFunc, func))
+            glDepthFunc(func);
+    }
+
+    void CullFace(GLenum mode)
+    {
+        if (changes(cullMode, mode))
+            glCullFace(mode);
+    }
+
+    void BlendFunc(GLenum source, GLenum destination)
+    {
+        if (blendSource == source && blendDestination == destination)
+        {
+            filtered++;
+            return;
+        }
+        blendSource = source;
+        blendDestination = destination;
+        glBlendFunc(source, destination);
+        issued++;
+    }
+
+private:
+    static const GLuint UNKNOWN = 0xffffffffu;
+
+    GLuint program, vertexArray, activeUnit;
+    GLuint textures[MAX_TEXTURE_UNITS][2];  // GL_TEXTURE_2D and GL_TEXTURE_CUBE_MAP binding of every unit
+    int depthTest, blend, cullFace, depthClamp, depthMask;  // -1 while unknown
+    GLuint depthFunc, cullMode, blendSource, blendDestination;
+    unsigned int issued = 0, filtered = 0, lastIssued = 0, lastFiltered = 0;
+
+    template<class T>
+    bool changes(T &current, T value)
+    {
+        if (current == value)
+        {
+            filtered++;
+            return false;
+        }
+        current = value;
+        issued++;
+        return true;
+    }
+
+    static int targetSlot(GLenum target)
+    {
+        return target == GL_TEXTURE_2D ? 0 : target == GL_TEXTURE_CUBE_MAP ? 1 : -1;
+    }
+
+    void setCapability(GLenum capability, bool enabled)
+    {
+        int *state = capability == GL_DEPTH_TEST ? &depthTest : capability == GL_BLEND ? &blend
+                     : capability == GL_CULL_FACE ? &cullFace : capability == GL_DEPTH_CLAMP ? &depthClamp : nullptr;
+        if (state && !changes(*state, enabled ? 1 : 0))
+            return;
+        if (!state)
+            issued++;
+        if (enabled)
+            glEnable(capability);
+        else
+            glDisable(capability);
+    }
+};
+
+// tracker for the one GL context the application renders with
+inline RenderState &renderState()
+{
+    static RenderState state;
+    return state;
+}
+#endif
@@ -0,0 +1,699 @@
+#ifndef SCENE_FILE_H
+#define SCENE_FILE_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <learnopengl/mesh_cache.h>
+#include <learnopengl/quad_instances.h>
+#include <learnopengl/scene_uniforms.h>
+
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Scene description read from a text file (<name>.scene), one statement per line, '#' starts a comment and
+// paths with spaces go in double quotes. Angles are in degrees.
+//   model <name> <path> [packed] [emissive] [lod]
+//                                                 a model file, packed uses the compact vertex layout,
+//                                                 emissive draws it with the light source program,
+//                                                 lod builds simplified levels of detail at import
+//   object <model> <transform>                   a static placement, the transform is a list of
+//                                                 translate x y z | scale s | scale x y z | rotate degrees x y z
+//                                                 applied left to right like the matching glm calls
+//   lantern <model> mount x y z base x y z [phase p] [length l] [scale s]
+//                                                 a swinging lantern carrying a point light, with a spot light at its base
+//   dirlight direction x y z ambient r g b diffuse r g b specular r g b
+//   pointlight ambient r g b diffuse r g b specular r g b attenuation constant linear quadratic
+//   spotlight ambient r g b diffuse r g b specular r g b attenuation constant linear quadratic cutoff inner outer
+//   shininess s
+//   view_distance d                              how far from the origin the far-field darkening reaches black,
+//                                                 past it only the lanterns light the ground below y = 1
+//   water <texture>, water_square x y z          the lake, one square per line
+//   grass <texture> [radius r], grass_tuft x y z [yaw degrees] [scale s]
+//   waterfall <texture>, waterfall_tile x y z [yaw degrees] [pitch degrees] [scale s]
+//   ripple <texture>, ripple_at x y z
+//   skybox <front> <back> <top> <bottom> <left> <right>
+// Everything lands in flat arrays of plain structs. Parsing the text is only for iterating on a scene: loadScene
+// writes the parsed arrays to a binary variant next to it (<name>.scenebin) and reads that one as long as the text
+// has not changed, a build can ship the binary file alone.
+
+enum class SceneShader : uint32_t { Lit, Emissive };
+
+struct SceneModel {
+    string name;
+    string path;
+    VertexFormat format = VertexFormat::Full;
+    SceneShader shader = SceneShader::Lit;
+    uint32_t lodLevels = 1;   // Model::lodLevels
+};
+
+struct SceneObject {
+    uint32_t model;     // index into SceneDescription::models
+    glm::mat4 local;
+};
+
+struct SceneLantern {
+    uint32_t model;
+    glm::vec3 mount;    // the lantern swings around this point
+    glm::vec3 base;     // where its spot light sits, in the lantern's space
+    float phase;        // offset of the swing, so the lanterns do not move in lockstep
+    float length;       // how far below the mount it hangs, in mount units
+    float scale;
+};
+
+struct SceneDescription {
+    vector<SceneModel> models;
+    vector<SceneObject> objects;
+    vector<SceneLantern> lanterns;
+    // every point and spot light starts from these, positions and directions come from the lanterns
+    DirLightBlock dirLight = DirLightBlock();
+    PointLightBlock pointLight = PointLightBlock();
+    SpotLightBlock spotLight = SpotLightBlock();
+    float shininess = 32.0f;
+    float viewDistance = 50.0f;
+    string waterTexture;
+    vector<glm::vec3> waterSquares;
+    string grassTexture;
+    float grassRadius = 0.3f;          // how far the cards of a tuft scatter at higher densities
+    vector<QuadInstance> grassTufts;
+    string waterfallTexture;
+    vector<QuadInstance> waterfallTiles;
+    string rippleTexture;
+    vector<glm::vec3> ripples;
+    vector<string> skyboxFaces;
+};
+
+// splits one line of the text format into words, keeps quoted words together and drops the comment
+class SceneLine
+{
+public:
+    SceneLine(const string &line, const string &file, unsigned int number) : file(file), number(number)
+    {
+        size_t i = 0;
+        while (i < line.size())
+        {
+            if (isspace((unsigned char)line[i]))
+            {
+                i++;
+                continue;
+            }
+            if (line[i] == '#')
+                break;
+            if (line[i] == '"')
+            {
+                size_t end = line.find('"', i + 1);
+                if (end == string::npos)
+                    end = line.size();
+                words.push_back(line.substr(i + 1, end - i - 1));
+                i = end + 1;
+                continue;
+            }
+            size_t start = i;
+            while (i < line.size() && !isspace((unsigned char)line[i]))
+                i++;
+            words.push_back(line.substr(start, i - start));
+        }
+    }
+
+    bool Empty() const { return words.empty(); }
+    bool Done() const { return next >= words.size(); }
+
+    bool Word(string &word)
+    {
+        if (Done())
+            return Fail("unexpected end of line");
+        word = words[next++];
+        return true;
+    }
+
+    bool Float(float &value)
+    {
+        if (!NextIsNumber())
+            return Fail(Done() ? "expected a number at the end of the line" : "expected a number instead of " + words[next]);
+        value = strtof(words[next++].c_str(), nullptr);
+        return true;
+    }
+
+    bool Vec3(glm::vec3 &value)
+    {
+        return Float(value.x) && Float(value.y) && Float(value.z);
+    }
+
+    bool NextIsNumber() const
+    {
+        if (Done())
+            return false;
+        char *end = nullptr;
+        strtof(words[next].c_str(), &end);
+        return end != words[next].c_str() && *end == '\0';
+    }
+
+    bool Fail(const string &message) const
+    {
+        cout << "ERROR::SCENE:: " << file << ":" << number << ": " << message << endl;
+        return false;
+    }
+
+private:
+    vector<string> words;
+    size_t next = 0;
+    const string &file;
+    unsigned int number;
+};
+
+inline bool parseTransform(SceneLine &line, glm::mat4 &local)
+{
+    local = glm::mat4(1.0f);
+    string op;
+    while (!line.Done())
+    {
+        line.Word(op);
+        glm::vec3 value;
+        if (op == "translate")
+        {
+            if (!line.Vec3(value))
+                return false;
+            local = glm::translate(local, value);
+        }
+        else if (op == "scale")
+        {
+            if (!line.Float(value.x))
+                return false;
+            value.y = value.z = value.x;
+            if (line.NextIsNumber() && !(line.Float(value.y) && line.Float(value.z)))
+                return false;
+            local = glm::scale(local, value);
+        }
+        else if (op == "rotate")
+        {
+            float degrees;
+            if (!line.Float(degrees) || !line.Vec3(value))
+                return false;
+            local = glm::rotate(local, glm::radians(degrees), value);
+        }
+        else
+            return line.Fail("unknown transform " + op);
+    }
+    return true;
+}
+
+// reads "key values" pairs until the end of the line, read consumes the values of a key or clears known
+template<class Read>
+bool parseProperties(SceneLine &line, Read read)
+{
+    string key;
+    while (!line.Done())
+    {
+        line.Word(key);
+        bool known = true;
+        if (!read(key, known))
+            return false;
+        if (!known)
+            return line.Fail("unknown property " + key);
+    }
+    return true;
+}
+
+inline bool parseLightColors(SceneLine &line, const string &key, bool &known, glm::vec3 &ambient, glm::vec3 &diffuse, glm::vec3 &specular)
+{
+    if (key == "ambient")
+        return line.Vec3(ambient);
+    if (key == "diffuse")
+        return line.Vec3(diffuse);
+    if (key == "specular")
+        return line.Vec3(specular);
+    known = false;
+    return true;
+}
+
+inline bool parseQuad(SceneLine &line, QuadInstance &quad)
+{
+    quad = {glm::vec3(0.0f), 0.0f, 0.0f, 1.0f};
+    if (!line.Vec3(quad.position))
+        return false;
+    return parseProperties(line, [&](const string &key, bool &known) {
+        float value;
+        if (key != "yaw" && key != "pitch" && key != "scale")
+        {
+            known = false;
+            return true;
+        }
+        if (!line.Float(value))
+            return false;
+        if (key == "yaw")
+            quad.yaw = glm::radians(value);
+        else if (key == "pitch")
+            quad.pitch = glm::radians(value);
+        else
+            quad.scale = value;
+        return true;
+    });
+}
+
+inline bool findSceneModel(SceneLine &line, const SceneDescription &scene, uint32_t &model)
+{
+    string name;
+    if (!line.Word(name))
+        return false;
+    for (model = 0; model < scene.models.size(); model++)
+        if (scene.models[model].name == name)
+            return true;
+    return line.Fail("unknown model " + name + ", models have to be declared before they are placed");
+}
+
+inline bool parseSceneStatement(SceneLine &line, SceneDescription &scene)
+{
+    string keyword;
+    line.Word(keyword);
+    if (keyword == "model")
+    {
+        SceneModel model;
+        if (!line.Word(model.name) || !line.Word(model.path))
+            return false;
+        string option;
+        while (!line.Done())
+        {
+            line.Word(option);
+            if (option == "packed")
+                model.format = VertexFormat::Packed;
+            else if (option == "emissive")
+                model.shader = SceneShader::Emissive;
+            else if (option == "lod")
+                model.lodLevels = MAX_LOD_LEVELS;
+            else
+                return line.Fail("unknown model option " + option);
+        }
+        scene.models.push_back(model);
+        return true;
+    }
+    if (keyword == "object")
+    {
+        SceneObject object;
+        if (!findSceneModel(line, scene, object.model) || !parseTransform(line, object.local))
+            return false;
+        scene.objects.push_back(object);
+        return true;
+    }
+    if (keyword == "lantern")
+    {
+        SceneLantern lantern = {0, glm::vec3(0.0f), glm::vec3(0.0f), 0.0f, 3.0f, 0.08f};
+        if (!findSceneModel(line, scene, lantern.model))
+            return false;
+        if (!parseProperties(line, [&](const string &key, bool &known) {
+                if (key == "mount")
+                    return line.Vec3(lantern.mount);
+                if (key == "base")
+                    return line.Vec3(lantern.base);
+                if (key == "phase")
+                    return line.Float(lantern.phase);
+                if (key == "length")
+                    return line.Float(lantern.length);
+                if (key == "scale")
+                    return line.Float(lantern.scale);
+                known = false;
+                return true;
+            }))
+            return false;
+        scene.lanterns.push_back(lantern);
+        return true;
+    }
+    if (keyword == "dirlight")
+    {
+        DirLightBlock &light = scene.dirLight;
+        return parseProperties(line, [&](const string &key, bool &known) {
+            if (key == "direction")
+                return line.Vec3(light.direction);
+            return parseLightColors(line, key, known, light.ambient, light.diffuse, light.specular);
+        });
+    }
+    if (keyword == "pointlight")
+    {
+        PointLightBlock &light = scene.pointLight;
+        return parseProperties(line, [&](const string &key, bool &known) {
+            if (key == "attenuation")
+                return line.Float(light.constant) && line.Float(light.linear) && line.Float(light.quadratic);
+            return parseLightColors(line, key, known, light.ambient, light.diffuse, light.specular);
+        });
+    }
+    if (keyword == "spotlight")
+    {
+        SpotLightBlock &light = scene.spotLight;
+        return parseProperties(line, [&](const string &key, bool &known) {
+            if (key == "attenuation")
+                return line.Float(light.constant) && line.Float(light.linear) && line.Float(light.quadratic);
+            if (key == "cutoff")
+            {
+                float inner, outer;
+                if (!line.Float(inner) || !line.Float(outer))
+                    return false;
+                // the shader compares against cosines
+                light.cutOff = glm::cos(glm::radians(inner));
+                light.outerCutOff = glm::cos(glm::radians(outer));
+                return true;
+            }
+            return parseLightColors(line, key, known, light.ambient, light.diffuse, light.specular);
+        });
+    }
+    if (keyword == "shininess")
+        return line.Float(scene.shininess);
+    if (keyword == "view_distance")
+    {
+        if (!line.Float(scene.viewDistance))
+            return false;
+        return (scene.viewDistance > 0.0f && scene.viewDistance < INFINITY) || line.Fail("the view distance has to be positive");
+    }
+    if (keyword == "water")
+        return line.Word(scene.waterTexture);
+    if (keyword == "water_square")
+    {
+        glm::vec3 position;
+        if (!line.Vec3(position))
+            return false;
+        scene.waterSquares.push_back(position);
+        return true;
+    }
+    if (keyword == "grass")
+    {
+        if (!line.Word(scene.grassTexture))
+            return false;
+        return parseProperties(line, [&](const string &key, bool &known) {
+            if (key == "radius")
+                return line.Float(scene.grassRadius);
+            known = false;
+            return true;
+        });
+    }
+    if (keyword == "grass_tuft" || keyword == "waterfall_tile")
+    {
+        QuadInstance quad;
+        if (!parseQuad(line, quad))
+            return false;
+        (keyword == "grass_tuft" ? scene.grassTufts : scene.waterfallTiles).push_back(quad);
+        return true;
+    }
+    if (keyword == "waterfall")
+        return line.Word(scene.waterfallTexture);
+    if (keyword == "ripple")
+        return line.Word(scene.rippleTexture);
+    if (keyword == "ripple_at")
+    {
+        glm::vec3 position;
+        if (!line.Vec3(position))
+            return false;
+        scene.ripples.push_back(position);
+        return true;
+    }
+    if (keyword == "skybox")
+    {
+        scene.skyboxFaces.resize(6);
+        for (string &face : scene.skyboxFaces)
+            if (!line.Word(face))
+                return false;
+        return true;
+    }
+    return line.Fail("unknown statement " + keyword);
+}
+
+// parses the text format, stops at the first error and reports it with file and line
+inline bool parseSceneText(const string &path, SceneDescription &scene)
+{
+    ifstream in(path);
+    if (!in)
+    {
+        cout << "ERROR::SCENE:: could not open " << path << endl;
+        return false;
+    }
+    scene = SceneDescription();
+    string text;
+    unsigned int number = 0;
+    while (getline(in, text))
+    {
+        SceneLine line(text, path, ++number);
+        if (line.Empty())
+            continue;
+        if (!parseSceneStatement(line, scene))
+            return false;
+        if (!line.Done())
+            return line.Fail("unexpected words at the end of the line");
+    }
+    return true;
+}
+
+// Binary variant: a header, the plain arrays back to back as they are in memory, then the strings, each
+// with a 32-bit length. Stamped with the size and time of the text it was made from.
+const char SCENE_BINARY_MAGIC[4] = {'R', 'G', 'S', 'C'};
+const uint32_t SCENE_BINARY_VERSION = 3;
+
+struct SceneBinaryHeader {
+    char     magic[4];
+    uint32_t version;
+    uint64_t sourceSize;
+    int64_t  sourceMtime;
+    uint32_t modelCount;
+    uint32_t objectCount;
+    uint32_t lanternCount;
+    uint32_t waterSquareCount;
+    uint32_t grassTuftCount;
+    uint32_t waterfallTileCount;
+    uint32_t rippleCount;
+    uint32_t skyboxFaceCount;
+    float    shininess;
+    float    grassRadius;
+    float    viewDistance;
+};
+
+class SceneBinary
+{
+public:
+    static string pathFor(const string &textPath)
+    {
+        return textPath + "bin";
+    }
+
+    static bool isBinary(const string &path)
+    {
+        const string extension = ".scenebin";
+        return path.size() >= extension.size() && path.compare(path.size() - extension.size(), extension.size(), extension) == 0;
+    }
+
+    // reads a binary scene, source is the stamp of the text it has to match, or null to take it regardless.
+    // Counts are checked against the bytes left in the file and values get the checks the text parser makes, a
+    // damaged or hand made binary fails instead of allocating or drawing garbage
+    static bool read(const string &path, SceneDescription &scene, const SourceStamp *source)
+    {
+        ifstream in(path, ios::binary | ios::ate);
+        if (!in)
+            return false;
+        uint64_t fileSize = (uint64_t)in.tellg();
+        in.seekg(0);
+        SceneBinaryHeader header;
+        if (!in.read((char*)&header, sizeof(header)) || memcmp(header.magic, SCENE_BINARY_MAGIC, sizeof(header.magic)) != 0
+            || header.version != SCENE_BINARY_VERSION)
+            return false;
+        if (source && (header.sourceSize != source->size || header.sourceMtime != source->mtime))
+            return false;
+        // a model takes at least its two string lengths, format, shader and levels of detail
+        const uint64_t minModelBytes = 5 * sizeof(uint32_t);
+        if (!(header.viewDistance > 0.0f && header.viewDistance < INFINITY)
+            || (header.skyboxFaceCount != 0 && header.skyboxFaceCount != 6)
+            || header.modelCount > bytesLeft(in, fileSize) / minModelBytes)
+            return false;
+        scene = SceneDescription();
+        scene.shininess = header.shininess;
+        scene.viewDistance = header.viewDistance;
+        scene.grassRadius = header.grassRadius;
+        scene.models.resize(header.modelCount);
+        if (!readArray(in, fileSize, scene.objects, header.objectCount) || !readArray(in, fileSize, scene.lanterns, header.lanternCount)
+            || !in.read((char*)&scene.dirLight, sizeof(scene.dirLight)) || !in.read((char*)&scene.pointLight, sizeof(scene.pointLight))
+            || !in.read((char*)&scene.spotLight, sizeof(scene.spotLight))
+            || !readArray(in, fileSize, scene.waterSquares, header.waterSquareCount)
+            || !readArray(in, fileSize, scene.grassTufts, header.grassTuftCount)
+            || !readArray(in, fileSize, scene.waterfallTiles, header.waterfallTileCount)
+            || !readArray(in, fileSize, scene.ripples, header.rippleCount))
+            return false;
+        for (SceneModel &model : scene.models)
+        {
+            uint32_t format, shader;
+            if (!readString(in, fileSize, model.name) || !readString(in, fileSize, model.path) || !in.read((char*)&format, sizeof(format))
+                || !in.read((char*)&shader, sizeof(shader)) || !in.read((char*)&model.lodLevels, sizeof(model.lodLevels)))
+                return false;
+            // the text only knows these values, and lod asks for MAX_LOD_LEVELS
+            if (format > (uint32_t)VertexFormat::Packed || shader > (uint32_t)SceneShader::Emissive
+                || model.lodLevels == 0 || model.lodLevels > MAX_LOD_LEVELS)
+                return false;
+            model.format = (VertexFormat)format;
+            model.shader = (SceneShader)shader;
+        }
+        scene.skyboxFaces.resize(header.skyboxFaceCount);
+        for (string &face : scene.skyboxFaces)
+            if (!readString(in, fileSize, face))
+                return false;
+        if (!readString(in, fileSize, scene.waterTexture) || !readString(in, fileSize, scene.grassTexture)
+            || !readString(in, fileSize, scene.waterfallTexture) || !readString(in, fileSize, scene.rippleTexture))
+            return false;
+        // a model index past the end would only show up once the scene is drawn
+        for (const SceneObject &object : scene.objects)
+            if (object.model >= scene.models.size())
+                return false;
+        for (const SceneLantern &lantern : scene.lanterns)
+            if (lantern.model >= scene.models.size())
+                return false;
+        return true;
+    }
+
+    // writes through a temporary file like the mesh cache, a crash never leaves half a scene behind
+    static bool write(const string &path, const SceneDescription &scene, const SourceStamp &source)
+    {
+        SceneBinaryHeader header;
+        memcpy(header.magic, SCENE_BINARY_MAGIC, sizeof(header.magic));
+        header.version = SCENE_BINARY_VERSION;
+        header.sourceSize = source.size;
+        header.sourceMtime = source.mtime;
+        header.modelCount = (uint32_t)scene.models.size();
+        header.objectCount = (uint32_t)scene.objects.size();
+        header.lanternCount = (uint32_t)scene.lanterns.size();
+        header.waterSquareCount = (uint32_t)scene.waterSquares.size();
+        header.grassTuftCount = (uint32_t)scene.grassTufts.size();
+        header.waterfallTileCount = (uint32_t)scene.waterfallTiles.size();
+        header.rippleCount = (uint32_t)scene.ripples.size();
+        header.skyboxFaceCount = (uint32_t)scene.skyboxFaces.size();
+        header.shininess = scene.shininess;
+        header.viewDistance = scene.viewDistance;
+        header.grassRadius = scene.grassRadius;
+
+        string tempPath = path + ".tmp";
+        ofstream out(tempPath, ios::binary | ios::trunc);
+        if (!out)
+            return false;
+        out.write((const char*)&header, sizeof(header));
+        writeArray(out, scene.objects);
+        writeArray(out, scene.lanterns);
+        out.write((const char*)&scene.dirLight, sizeof(scene.dirLight));
+        out.write((const char*)&scene.pointLight, sizeof(scene.pointLight));
+        out.write((const char*)&scene.spotLight, sizeof(scene.spotLight));
+        writeArray(out, scene.waterSquares);
+        writeArray(out, scene.grassTufts);
+        writeArray(out, scene.waterfallTiles);
+        writeArray(out, scene.ripples);
+        for (const SceneModel &model : scene.models)
+        {
+            uint32_t format = (uint32_t)model.format, shader = (uint32_t)model.shader;
+            writeString(out, model.name);
+            writeString(out, model.path);
+            out.write((const char*)&format, sizeof(format));
+            out.write((const char*)&shader, sizeof(shader));
+            out.write((const char*)&model.lodLevels, sizeof(model.lodLevels));
+        }
+        for (const string &face : scene.skyboxFaces)
+            writeString(out, face);
+        writeString(out, scene.waterTexture);
+        writeString(out, scene.grassTexture);
+        writeString(out, scene.waterfallTexture);
+        writeString(out, scene.rippleTexture);
+        out.close();
+        if (!out)
+        {
+            remove(tempPath.c_str());
+            return false;
+        }
+        return rename(tempPath.c_str(), path.c_str()) == 0;
+    }
+
+private:
+    static uint64_t bytesLeft(ifstream &in, uint64_t fileSize)
+    {
+        streamoff position = in.tellg();
+        return position < 0 || (uint64_t)position > fileSize ? 0 : fileSize - (uint64_t)position;
+    }
+
+    template<class T>
+    static bool readArray(ifstream &in, uint64_t fileSize, vector<T> &values, uint32_t count)
+    {
+        if (count > bytesLeft(in, fileSize) / sizeof(T))
+            return false;
+        values.resize(count);
+        return count == 0 || in.read((char*)values.data(), (streamsize)(count * sizeof(T)));
+    }
+
+    template<class T>
+    static void writeArray(ofstream &out, const vector<T> &values)
+    {
+        if (!values.empty())
+            out.write((const char*)values.data(), (streamsize)(values.size() * sizeof(T)));
+    }
+
+    static bool readString(ifstream &in, uint64_t fileSize, string &value)
+    {
+        uint32_t length;
+        if (!in.read((char*)&length, sizeof(length)) || length > (1u << 16) || length > bytesLeft(in, fileSize))
+            return false;
+        value.resize(length);
+        return length == 0 || in.read(&value[0], length);
+    }
+
+    static void writeString(ofstream &out, const string &value)
+    {
+        uint32_t length = (uint32_t)value.size();
+        out.write((const char*)&length, sizeof(length));
+        out.write(value.data(), length);
+    }
+};
+
+// Loads a .scene text file through its binary variant: the binary is used while it matches the text, otherwise the
+// text is parsed and the binary rewritten. Without the text the binary is taken as it is, and a .scenebin path is
+// always read directly.
+inline bool loadScene(const string &path, SceneDescription &scene)
+{
+    if (SceneBinary::isBinary(path))
+        return SceneBinary::read(path, scene, nullptr);
+    SourceStamp stamp;
+    if (!statSource(path, stamp))
+        return SceneBinary::read(SceneBinary::pathFor(path), scene, nullptr);
+    if (SceneBinary::read(SceneBinary::pathFor(path), scene, &stamp))
+        return true;
+    if (!parseSceneText(path, scene))
+        return false;
+    if (!SceneBinary::write(SceneBinary::pathFor(path), scene, stamp))
+        cout << "WARNING::SCENE:: could not write " << SceneBinary::pathFor(path) << endl;
+    return true;
+}
+
+// Notices edits to a scene text file. Polled from the render loop, it only looks at the file every interval seconds.
+class SceneFileWatcher
+{
+public:
+    SceneFileWatcher(const string &path, double interval = 0.5) : path(path), interval(interval)
+    {
+        statSource(path, stamp);
+    }
+
+    // true once for every change of the file's size or modification time
+    bool Poll(double now)
+    {
+        if (SceneBinary::isBinary(path) || now - lastPoll < interval)
+            return false;
+        lastPoll = now;
+        SourceStamp current;
+        if (!statSource(path, current) || (current.size == stamp.size && current.mtime == stamp.mtime))
+            return false;
+        stamp = current;
+        return true;
+    }
+
+private:
+    string path;
+    double interval;
+    double lastPoll = 0.0;
+    SourceStamp stamp;
+};
+#endif
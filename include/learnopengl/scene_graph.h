@@ -0,0 +1,75 @@
+#ifndef SCENE_GRAPH_H
+#define SCENE_GRAPH_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/mesh.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+// Transform hierarchy kept in flat arrays. A node's parent always comes before it, so one pass in index order
+// updates the whole scene. World and normal matrices are only recomputed for nodes whose local transform changed
+// since the last Update and for everything below them; static nodes pay for their matrices once.
+class SceneGraph
+{
+public:
+    static const int NO_PARENT = -1;
+
+    // adds a node below parent (NO_PARENT for a root) and returns its index, parents have to be added first
+    unsigned int AddNode(const glm::mat4 &local, int parent = NO_PARENT)
+    {
+        locals.push_back(local);
+        parents.push_back(parent);
+        transforms.push_back(WorldTransform());
+        dirty.push_back(1);
+        return (unsigned int)locals.size() - 1;
+    }
+
+    void SetLocal(unsigned int node, const glm::mat4 &local)
+    {
+        locals[node] = local;
+        dirty[node] = 1;
+    }
+
+    const glm::mat4 &Local(unsigned int node) const { return locals[node]; }
+
+    // recomputes the world and normal matrices of the changed nodes and their descendants
+    void Update()
+    {
+        updatedNodes = 0;
+        for (size_t node = 0; node < locals.size(); node++)
+        {
+            int parent = parents[node];
+            if (parent != NO_PARENT && dirty[parent])
+                dirty[node] = 1;
+            if (!dirty[node])
+                continue;
+            WorldTransform &transform = transforms[node];
+            transform.model = parent == NO_PARENT ? locals[node] : transforms[parent].model * locals[node];
+            transform.normal = glm::transpose(glm::inverse(glm::mat3(transform.model)));
+            updatedNodes++;
+        }
+        // cleared afterwards, the pass above still needs the flags of the parents
+        std::fill(dirty.begin(), dirty.end(), 0);
+    }
+
+    // world transform as of the last Update
+    const WorldTransform &Transform(unsigned int node) const { return transforms[node]; }
+    glm::vec3 Position(unsigned int node) const { return glm::vec3(transforms[node].model[3]); }
+
+    unsigned int NodeCount() const { return (unsigned int)locals.size(); }
+    // nodes the last Update had to recompute
+    unsigned int UpdatedNodes() const { return updatedNodes; }
+
+private:
+    vector<glm::mat4> locals;
+    vector<int> parents;
+    vector<WorldTransform> transforms;
+    vector<uint8_t> dirty;
+    unsigned int updatedNodes = 0;
+};
+#endif
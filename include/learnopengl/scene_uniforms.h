@@ -0,0 +1,141 @@
+#ifndef SCENE_UNIFORMS_H
+#define SCENE_UNIFORMS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/shader_m.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+// C++ mirrors of the std140 uniform blocks declared in resources/shaders. Every vec3 is followed by a float so
+// the members land on the same offsets as in GLSL, where a vec3 is 16 byte aligned but only 12 bytes big.
+#define NR_POINT_LIGHTS 2
+#define NR_SPOTLIGHTS 2
+
+// layout (std140) uniform Camera, the per-frame camera block
+struct CameraBlock {
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::mat4 skyboxView;   // view without the translation
+    glm::vec3 viewPos;
+    float     currentFrame; // seconds since start, drives the water and waterfall animations
+    float     maxViewDistance; // distance from the origin where the far-field darkening reaches black
+    float     pad0, pad1, pad2;
+};
+
+struct DirLightBlock {
+    glm::vec3 direction; float pad0;
+    glm::vec3 ambient;   float pad1;
+    glm::vec3 diffuse;   float pad2;
+    glm::vec3 specular;  float pad3;
+};
+
+struct PointLightBlock {
+    glm::vec3 position;  float constant;
+    glm::vec3 ambient;   float linear;
+    glm::vec3 diffuse;   float quadratic;
+    glm::vec3 specular;  float pad0;
+};
+
+// distance at which a point light has faded to 5/256 of its brightest diffuse channel, about where it stops
+// making a visible difference. Solves constant + linear * d + quadratic * d^2 = brightest * 256 / 5 for d
+inline float pointLightRange(const PointLightBlock &light)
+{
+    float threshold = std::max(std::max(light.diffuse.x, light.diffuse.y), light.diffuse.z) * 256.0f / 5.0f;
+    if (threshold <= light.constant)
+        return 0.0f;
+    if (light.quadratic > 0.0f)
+        return (-light.linear + std::sqrt(light.linear * light.linear - 4.0f * light.quadratic * (light.constant - threshold)))
+               / (2.0f * light.quadratic);
+    return light.linear > 0.0f ? (threshold - light.constant) / light.linear : FLT_MAX;
+}
+
+struct SpotLightBlock {
+    glm::vec3 position;  float cutOff;
+    glm::vec3 direction; float outerCutOff;
+    glm::vec3 ambient;   float constant;
+    glm::vec3 diffuse;   float linear;
+    glm::vec3 specular;  float quadratic;
+};
+
+// layout (std140) uniform Lights, the per-frame lights block
+struct LightsBlock {
+    DirLightBlock   dirLight;
+    PointLightBlock pointLights[NR_POINT_LIGHTS];
+    SpotLightBlock  spotLights[NR_SPOTLIGHTS];
+};
+
+static_assert(sizeof(CameraBlock) == 224, "CameraBlock must match the std140 layout of the Camera block");
+static_assert(sizeof(LightsBlock) == 64 + 64 * NR_POINT_LIGHTS + 80 * NR_SPOTLIGHTS,
+              "LightsBlock must match the std140 layout of the Lights block");
+
+// Owns the uniform buffer behind the Camera and Lights blocks. Both blocks live in one buffer at offsets that respect
+// GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, get bound to their binding points with glBindBufferRange and are
+// refreshed with a single buffer write per frame. Needs a current GL context when constructed.
+class SceneUniforms
+{
+public:
+    static const GLuint CAMERA_BINDING = 0;
+    static const GLuint LIGHTS_BINDING = 1;
+
+    CameraBlock camera;
+    LightsBlock lights;
+
+    SceneUniforms()
+    {
+        GLint alignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        lightsOffset = alignUp(sizeof(CameraBlock), (size_t)alignment);
+        staging.resize(lightsOffset + sizeof(LightsBlock));
+
+        glGenBuffers(1, &UBO);
+        glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+        glBufferData(GL_UNIFORM_BUFFER, staging.size(), nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferRange(GL_UNIFORM_BUFFER, CAMERA_BINDING, UBO, 0, sizeof(CameraBlock));
+        glBindBufferRange(GL_UNIFORM_BUFFER, LIGHTS_BINDING, UBO, lightsOffset, sizeof(LightsBlock));
+    }
+
+    SceneUniforms(const SceneUniforms &) = delete;
+    SceneUniforms &operator=(const SceneUniforms &) = delete;
+
+    // deletes the buffer, called at shutdown while the context still exists
+    void Release()
+    {
+        glDeleteBuffers(1, &UBO);
+        UBO = 0;
+    }
+
+    // points the blocks the program declares at the shared binding points, once per program
+    void Bind(const Shader &shader) const
+    {
+        shader.bindUniformBlock("Camera", CAMERA_BINDING);
+        shader.bindUniformBlock("Lights", LIGHTS_BINDING);
+    }
+
+    // sends both blocks to the GPU, orphaning the old storage so the driver never waits on the previous frame
+    void Upload()
+    {
+        memcpy(staging.data(), &camera, sizeof(CameraBlock));
+        memcpy(staging.data() + lightsOffset, &lights, sizeof(LightsBlock));
+        glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+        glBufferData(GL_UNIFORM_BUFFER, staging.size(), staging.data(), GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+private:
+    unsigned int UBO = 0;
+    size_t lightsOffset = 0;
+    std::vector<unsigned char> staging;
+
+    static size_t alignUp(size_t offset, size_t alignment)
+    {
+        return (offset + alignment - 1) / alignment * alignment;
+    }
+};
+#endif
@@ -4,11 +4,23 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include <cstdint>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <unordered_map>
 #include <common.h>
+
+#include <learnopengl/render_state.h>
+
+// handle to a uniform of one program, resolve it once with Shader::uniform and set it without any name lookup
+struct Uniform {
+    GLint location = -1;
+
+    bool valid() const { return location >= 0; }
+};
+
 class Shader
 {
 public:
@@ -76,73 +88,180 @@ public:
         glDeleteShader(vertex);
         glDeleteShader(fragment);
 
+        buildUniformTable();
     }
     // activate the shader
     // ------------------------------------------------------------------------
     void use() const
     { 
-        glUseProgram(ID); 
+        renderState().UseProgram(ID);
     }
-    // utility uniform functions
+    // location of a uniform, looked up in the table built at link time instead of asking the driver.
+    // like glGetUniformLocation it returns -1 for names that are not active in the program
     // ------------------------------------------------------------------------
-    void setBool(const std::string &name, bool value) const
-    {         
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value); 
+    GLint location(const char *name) const
+    {
+        std::unordered_map<uint64_t, GLint>::const_iterator found = locations.find(hashName(name));
+        return found != locations.end() ? found->second : -1;
     }
+    GLint location(const std::string &name) const
+    {
+        return location(name.c_str());
+    }
+    // resolves a uniform once, for code that sets it every frame
+    Uniform uniform(const char *name) const
+    {
+        Uniform handle;
+        handle.location = location(name);
+        return handle;
+    }
+    // attaches a uniform block of this program to a binding point, programs without the block are left alone
     // ------------------------------------------------------------------------
-    void setInt(const std::string &name, int value) const
-    { 
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value); 
+    void bindUniformBlock(const char *blockName, GLuint binding) const
+    {
+        GLuint index = glGetUniformBlockIndex(ID, blockName);
+        if (index != GL_INVALID_INDEX)
+            glUniformBlockBinding(ID, index, binding);
     }
+    // utility uniform functions, the name overloads take C strings so literals are looked up without allocating
     // ------------------------------------------------------------------------
-    void setFloat(const std::string &name, float value) const
-    { 
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value); 
+    void setBool(Uniform uniform, bool value) const
+    {
+        glUniform1i(uniform.location, (int)value);
     }
+    void setBool(const char *name, bool value) const { setBool(uniform(name), value); }
+    void setBool(const std::string &name, bool value) const { setBool(name.c_str(), value); }
     // ------------------------------------------------------------------------
-    void setVec2(const std::string &name, const glm::vec2 &value) const
-    { 
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+    void setInt(Uniform uniform, int value) const
+    {
+        glUniform1i(uniform.location, value);
     }
-    void setVec2(const std::string &name, float x, float y) const
-    { 
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y); 
+    void setInt(const char *name, int value) const { setInt(uniform(name), value); }
+    void setInt(const std::string &name, int value) const { setInt(name.c_str(), value); }
+    // ------------------------------------------------------------------------
+    void setFloat(Uniform uniform, float value) const
+    {
+        glUniform1f(uniform.location, value);
     }
+    void setFloat(const char *name, float value) const { setFloat(uniform(name), value); }
+    void setFloat(const std::string &name, float value) const { setFloat(name.c_str(), value); }
     // ------------------------------------------------------------------------
-    void setVec3(const std::string &name, const glm::vec3 &value) const
-    { 
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+    void setVec2(Uniform uniform, const glm::vec2 &value) const
+    {
+        glUniform2fv(uniform.location, 1, &value[0]);
     }
-    void setVec3(const std::string &name, float x, float y, float z) const
-    { 
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z); 
+    void setVec2(Uniform uniform, float x, float y) const
+    {
+        glUniform2f(uniform.location, x, y);
     }
+    void setVec2(const char *name, const glm::vec2 &value) const { setVec2(uniform(name), value); }
+    void setVec2(const char *name, float x, float y) const { setVec2(uniform(name), x, y); }
+    void setVec2(const std::string &name, const glm::vec2 &value) const { setVec2(name.c_str(), value); }
+    void setVec2(const std::string &name, float x, float y) const { setVec2(name.c_str(), x, y); }
     // ------------------------------------------------------------------------
-    void setVec4(const std::string &name, const glm::vec4 &value) const
-    { 
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+    void setVec3(Uniform uniform, const glm::vec3 &value) const
+    {
+        glUniform3fv(uniform.location, 1, &value[0]);
     }
-    void setVec4(const std::string &name, float x, float y, float z, float w) const
-    { 
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w); 
+    void setVec3(Uniform uniform, float x, float y, float z) const
+    {
+        glUniform3f(uniform.location, x, y, z);
+    }
+    void setVec3(const char *name, const glm::vec3 &value) const { setVec3(uniform(name), value); }
+    void setVec3(const char *name, float x, float y, float z) const { setVec3(uniform(name), x, y, z); }
+    void setVec3(const std::string &name, const glm::vec3 &value) const { setVec3(name.c_str(), value); }
+    void setVec3(const std::string &name, float x, float y, float z) const { setVec3(name.c_str(), x, y, z); }
+    // ------------------------------------------------------------------------
+    void setVec4(Uniform uniform, const glm::vec4 &value) const
+    {
+        glUniform4fv(uniform.location, 1, &value[0]);
     }
+    void setVec4(Uniform uniform, float x, float y, float z, float w) const
+    {
+        glUniform4f(uniform.location, x, y, z, w);
+    }
+    void setVec4(const char *name, const glm::vec4 &value) const { setVec4(uniform(name), value); }
+    void setVec4(const char *name, float x, float y, float z, float w) const { setVec4(uniform(name), x, y, z, w); }
+    void setVec4(const std::string &name, const glm::vec4 &value) const { setVec4(name.c_str(), value); }
+    void setVec4(const std::string &name, float x, float y, float z, float w) const { setVec4(name.c_str(), x, y, z, w); }
     // ------------------------------------------------------------------------
-    void setMat2(const std::string &name, const glm::mat2 &mat) const
+    void setMat2(Uniform uniform, const glm::mat2 &mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix2fv(uniform.location, 1, GL_FALSE, &mat[0][0]);
     }
+    void setMat2(const char *name, const glm::mat2 &mat) const { setMat2(uniform(name), mat); }
+    void setMat2(const std::string &name, const glm::mat2 &mat) const { setMat2(name.c_str(), mat); }
     // ------------------------------------------------------------------------
-    void setMat3(const std::string &name, const glm::mat3 &mat) const
+    void setMat3(Uniform uniform, const glm::mat3 &mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix3fv(uniform.location, 1, GL_FALSE, &mat[0][0]);
     }
+    void setMat3(const char *name, const glm::mat3 &mat) const { setMat3(uniform(name), mat); }
+    void setMat3(const std::string &name, const glm::mat3 &mat) const { setMat3(name.c_str(), mat); }
     // ------------------------------------------------------------------------
-    void setMat4(const std::string &name, const glm::mat4 &mat) const
+    void setMat4(Uniform uniform, const glm::mat4 &mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix4fv(uniform.location, 1, GL_FALSE, &mat[0][0]);
     }
+    void setMat4(const char *name, const glm::mat4 &mat) const { setMat4(uniform(name), mat); }
+    void setMat4(const std::string &name, const glm::mat4 &mat) const { setMat4(name.c_str(), mat); }
 
 private:
+    // active uniform name -> location, keyed by the name's hash so looking up a C string needs no std::string
+    std::unordered_map<uint64_t, GLint> locations;
+
+    // 64-bit FNV-1a
+    static uint64_t hashName(const char *name)
+    {
+        uint64_t hash = 14695981039346656037ULL;
+        for (; *name; name++)
+            hash = (hash ^ (unsigned char)*name) * 1099511628211ULL;
+        return hash;
+    }
+
+    void addLocation(const std::string &name, GLint location)
+    {
+        if (!locations.insert(std::make_pair(hashName(name.c_str()), location)).second)
+            std::cout << "WARNING::SHADER:: uniform name hash collision for " << name << std::endl;
+    }
+
+    // asks the linked program for all its active uniforms once. Arrays are reported as "name[0]" with a size,
+    // so "name" and every "name[i]" are registered. Uniforms living in uniform blocks have no location and are skipped
+    // ------------------------------------------------------------------------
+    void buildUniformTable()
+    {
+        locations.clear();
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::string name(maxLength > 0 ? maxLength : 1, '\0');
+        for (GLint i = 0; i < count; i++)
+        {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(ID, (GLuint)i, (GLsizei)name.size(), &length, &size, &type, &name[0]);
+            std::string uniformName = name.substr(0, length);
+            GLint location = glGetUniformLocation(ID, uniformName.c_str());
+            if (location < 0)
+                continue;
+            const std::string arraySuffix = "[0]";
+            if (uniformName.size() > arraySuffix.size()
+                && uniformName.compare(uniformName.size() - arraySuffix.size(), arraySuffix.size(), arraySuffix) == 0)
+            {
+                std::string base = uniformName.substr(0, uniformName.size() - arraySuffix.size());
+                addLocation(base, location);
+                for (GLint element = 0; element < size; element++)
+                {
+                    std::string elementName = base + "[" + std::to_string(element) + "]";
+                    addLocation(elementName, glGetUniformLocation(ID, elementName.c_str()));
+                }
+            }
+            else
+                addLocation(uniformName, location);
+        }
+    }
+
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(GLuint shader, std::string type)
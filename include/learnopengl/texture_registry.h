@@ -0,0 +1,159 @@
+#ifndef TEXTURE_REGISTRY_H
+#define TEXTURE_REGISTRY_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/texture_streamer.h>
+
+#include <climits>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+// a texture is shared whenever the same file is requested with the same sampler state
+struct TextureKey {
+    string path;    // canonical path, cube maps join their faces with '|'
+    GLenum target;
+    TextureSampling sampling;
+
+    bool operator==(const TextureKey &other) const
+    {
+        return target == other.target && sampling.wrap == other.sampling.wrap
+               && sampling.minFilter == other.sampling.minFilter && sampling.magFilter == other.sampling.magFilter
+               && path == other.path;
+    }
+};
+
+struct TextureKeyHash {
+    size_t operator()(const TextureKey &key) const
+    {
+        size_t hash = std::hash<string>()(key.path);
+        const GLint parts[4] = {(GLint)key.target, key.sampling.wrap, key.sampling.minFilter, key.sampling.magFilter};
+        for (GLint part : parts)
+            hash ^= std::hash<GLint>()(part) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+        return hash;
+    }
+};
+
+// Process wide texture cache on top of the streamer. Every Acquire of an already known key returns the same
+// GL texture and bumps its reference count, Release drops a reference and deletes the texture with the last one.
+class TextureRegistry
+{
+public:
+    TextureRegistry()
+    {
+        textureStreamer().SetUploadListener([this](unsigned int texture, size_t bytes) { accountUpload(texture, bytes); });
+    }
+
+    TextureRegistry(const TextureRegistry &) = delete;
+    TextureRegistry &operator=(const TextureRegistry &) = delete;
+
+    unsigned int Acquire2D(const string &path, const TextureSampling &sampling = TextureSampling())
+    {
+        string canonical = canonicalPath(path);
+        return acquire({canonical, GL_TEXTURE_2D, sampling}, [&]() { return textureStreamer().Request2D(canonical, sampling); });
+    }
+
+    unsigned int AcquireCubeMap(const vector<string> &faces, const TextureSampling &sampling)
+    {
+        vector<string> canonicalFaces;
+        string joined;
+        for (const string &face : faces)
+        {
+            canonicalFaces.push_back(canonicalPath(face));
+            joined += (joined.empty() ? "" : "|") + canonicalFaces.back();
+        }
+        return acquire({joined, GL_TEXTURE_CUBE_MAP, sampling}, [&]() { return textureStreamer().RequestCubeMap(canonicalFaces, sampling); });
+    }
+
+    void Release(unsigned int texture)
+    {
+        unordered_map<unsigned int, Entry>::iterator entry = entries.find(texture);
+        if (entry == entries.end() || --entry->second.references > 0)
+            return;
+        textureStreamer().Cancel(texture);
+        renderState().ForgetTexture(texture);
+        glDeleteTextures(1, &texture);
+        gpuBytes -= entry->second.bytes;
+        lookup.erase(entry->second.key);
+        entries.erase(entry);
+    }
+
+    // deletes every texture regardless of its references, used at shutdown while the context still exists
+    void Clear()
+    {
+        for (auto &entry : entries)
+        {
+            textureStreamer().Cancel(entry.first);
+            renderState().ForgetTexture(entry.first);
+            glDeleteTextures(1, &entry.first);
+        }
+        entries.clear();
+        lookup.clear();
+        gpuBytes = 0;
+    }
+
+    unsigned int TextureCount() const { return (unsigned int)entries.size(); }
+    // estimated video memory of all textures, mip chains included
+    size_t GpuBytes() const { return gpuBytes; }
+    // how many Acquire calls were answered with an existing texture
+    unsigned int SharedHits() const { return sharedHits; }
+
+private:
+    struct Entry {
+        TextureKey key;
+        unsigned int references;
+        size_t bytes;
+    };
+
+    unordered_map<TextureKey, unsigned int, TextureKeyHash> lookup;
+    unordered_map<unsigned int, Entry> entries;
+    size_t gpuBytes = 0;
+    unsigned int sharedHits = 0;
+
+    template<class Load>
+    unsigned int acquire(const TextureKey &key, Load load)
+    {
+        unordered_map<TextureKey, unsigned int, TextureKeyHash>::iterator found = lookup.find(key);
+        if (found != lookup.end())
+        {
+            entries[found->second].references++;
+            sharedHits++;
+            return found->second;
+        }
+        unsigned int texture = load();
+        lookup[key] = texture;
+        entries[texture] = {key, 1, 0};
+        return texture;
+    }
+
+    void accountUpload(unsigned int texture, size_t bytes)
+    {
+        unordered_map<unsigned int, Entry>::iterator entry = entries.find(texture);
+        if (entry == entries.end())
+            return;
+        gpuBytes += bytes - entry->second.bytes;
+        entry->second.bytes = bytes;
+    }
+
+    static string canonicalPath(const string &path)
+    {
+#ifndef _WIN32
+        char resolved[PATH_MAX];
+        if (realpath(path.c_str(), resolved))
+            return resolved;
+#endif
+        return path;
+    }
+};
+
+inline TextureRegistry &textureRegistry()
+{
+    static TextureRegistry registry;
+    return registry;
+}
+#endif
@@ -0,0 +1,392 @@
+#ifndef TEXTURE_STREAMER_H
+#define TEXTURE_STREAMER_H
+
+#include <glad/glad.h>
+#include <stb_image.h>
+
+#include <learnopengl/cooked_texture.h>
+#include <learnopengl/render_state.h>
+#include <learnopengl/thread_pool.h>
+
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// S3TC is an extension in core profiles, so glad does not define its formats
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+// how much pixel data Update may hand to the driver per frame, one texture is always uploaded even if it is larger
+const size_t TEXTURE_UPLOAD_BUDGET = 8 * 1024 * 1024;
+const unsigned int TEXTURE_UPLOAD_BUFFERS = 4;
+
+struct TextureSampling {
+    GLint wrap = GL_REPEAT;
+    GLint minFilter = GL_LINEAR_MIPMAP_LINEAR;
+    GLint magFilter = GL_LINEAR;
+
+    bool usesMipmaps() const
+    {
+        return minFilter != GL_LINEAR && minFilter != GL_NEAREST;
+    }
+};
+
+// Loads textures without blocking the render thread. Every request immediately returns a texture id
+// holding a 1x1 placeholder, the files are decoded on the worker pool and Update (called once per frame)
+// swaps the real images in through a small ring of pixel unpack buffers, within a per-frame byte budget.
+// A block compressed <image>.rgtex made by texture_cooker is preferred over the image itself when it is up to date.
+class TextureStreamer
+{
+public:
+    TextureStreamer() = default;
+    TextureStreamer(const TextureStreamer &) = delete;
+    TextureStreamer &operator=(const TextureStreamer &) = delete;
+
+    ~TextureStreamer()
+    {
+        // only CPU side cleanup here, the GL objects are released by Shutdown while the context still exists
+        releaseJobs();
+    }
+
+    // the orientation stb_image loads with from now on, cooked files made for the other one are not used
+    void SetFlipVertically(bool flip)
+    {
+        stbi_set_flip_vertically_on_load(flip ? 1 : 0);
+        flipVertically = flip;
+    }
+
+    unsigned int Request2D(const string &path, const TextureSampling &sampling = TextureSampling())
+    {
+        return request(GL_TEXTURE_2D, vector<string>{path}, sampling);
+    }
+
+    // faces in the order +X, -X, +Y, -Y, +Z, -Z
+    unsigned int RequestCubeMap(const vector<string> &faces, const TextureSampling &sampling)
+    {
+        return request(GL_TEXTURE_CUBE_MAP, faces, sampling);
+    }
+
+    // uploads textures whose decoding has finished, has to be called on the GL thread
+    void Update(size_t budgetBytes = TEXTURE_UPLOAD_BUDGET)
+    {
+        size_t uploaded = 0;
+        for (size_t i = 0; i < jobs.size() && (uploaded == 0 || uploaded < budgetBytes);)
+        {
+            Job &job = jobs[i];
+            if (job.images.empty())
+            {
+                if (job.decode.wait_for(chrono::seconds(0)) != future_status::ready)
+                {
+                    i++;
+                    continue;
+                }
+                job.images = job.decode.get();
+                if (job.images.empty() || job.cancelled)
+                {
+                    // decoding failed (the placeholder stays) or nobody wants the texture anymore
+                    freeImages(job.images);
+                    jobs.erase(jobs.begin() + i);
+                    continue;
+                }
+            }
+            size_t bytes = 0;
+            for (const DecodedImage &image : job.images)
+                bytes += image.size();
+            if (!uploadBuffersFree(job.images.size()))
+                break; // the GPU is still reading the previous uploads, try again next frame
+            if (!job.cancelled)
+            {
+                upload(job);
+                if (uploadListener)
+                    uploadListener(job.texture, residentBytes(job));
+            }
+            uploaded += bytes;
+            freeImages(job.images);
+            jobs.erase(jobs.begin() + i);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    unsigned int Pending() const { return (unsigned int)jobs.size(); }
+
+    // drops the pending upload of a texture that is about to be deleted
+    void Cancel(unsigned int texture)
+    {
+        for (Job &job : jobs)
+            if (job.texture == texture)
+                job.cancelled = true;
+    }
+
+    // called with the texture and its video memory size (mip chain included) whenever an upload is done
+    void SetUploadListener(function<void(unsigned int, size_t)> listener)
+    {
+        uploadListener = listener;
+    }
+
+    // waits for the outstanding decodes and releases the upload buffers, call before the context goes away
+    void Shutdown()
+    {
+        releaseJobs();
+        for (UploadBuffer &buffer : uploadBuffers)
+        {
+            if (buffer.fence)
+                glDeleteSync(buffer.fence);
+            if (buffer.id)
+                glDeleteBuffers(1, &buffer.id);
+        }
+        uploadBuffers.clear();
+    }
+
+private:
+    struct DecodedImage {
+        string path;
+        int width = 0, height = 0, channels = 0;
+        unsigned char *pixels = nullptr;
+        CookedTexture cooked; // used instead of pixels when the image was cooked offline
+
+        bool isCooked() const { return !cooked.levels.empty(); }
+        size_t size() const { return isCooked() ? cooked.data.size() : (size_t)width * height * channels; }
+    };
+
+    struct Job {
+        unsigned int texture;
+        GLenum target;
+        TextureSampling sampling;
+        future<vector<DecodedImage>> decode;
+        vector<DecodedImage> images;
+        bool cancelled = false;
+    };
+
+    struct UploadBuffer {
+        unsigned int id = 0;
+        size_t capacity = 0;
+        GLsync fence = nullptr;
+    };
+
+    vector<Job> jobs;
+    bool flipVertically = false;
+    function<void(unsigned int, size_t)> uploadListener;
+    vector<UploadBuffer> uploadBuffers;
+    unsigned int nextUploadBuffer = 0;
+
+    unsigned int request(GLenum target, const vector<string> &files, const TextureSampling &sampling)
+    {
+        unsigned int textureID;
+        glGenTextures(1, &textureID);
+        renderState().BindTexture(target, textureID);
+        const unsigned char placeholder[4] = {128, 128, 128, 255};
+        if (target == GL_TEXTURE_CUBE_MAP)
+        {
+            for (unsigned int face = 0; face < 6; face++)
+                glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
+            glTexParameteri(target, GL_TEXTURE_WRAP_R, sampling.wrap);
+        }
+        else
+            glTexImage2D(target, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
+        glTexParameteri(target, GL_TEXTURE_WRAP_S, sampling.wrap);
+        glTexParameteri(target, GL_TEXTURE_WRAP_T, sampling.wrap);
+        glTexParameteri(target, GL_TEXTURE_MIN_FILTER, sampling.minFilter);
+        glTexParameteri(target, GL_TEXTURE_MAG_FILTER, sampling.magFilter);
+
+        Job job;
+        job.texture = textureID;
+        job.target = target;
+        job.sampling = sampling;
+        bool allowCooked = compressedTexturesSupported();
+        bool flipped = flipVertically;
+        job.decode = workerPool().enqueue([files, allowCooked, flipped]() { return decode(files, allowCooked, flipped); });
+        jobs.push_back(std::move(job));
+        return textureID;
+    }
+
+    // runs on a worker thread, returns no images at all if any of the files fails to load.
+    // cooked files are only used if every file has one, a cube map can't mix compressed and plain faces
+    static vector<DecodedImage> decode(const vector<string> &files, bool allowCooked, bool flipped)
+    {
+        vector<DecodedImage> images(files.size());
+        bool cooked = allowCooked;
+        for (size_t i = 0; i < files.size() && cooked; i++)
+        {
+            string cookedPath = cookedPathFor(files[i]);
+            images[i].path = cookedPath;
+            cooked = cookedTextureUpToDate(files[i], cookedPath) && readCookedTexture(cookedPath, images[i].cooked, flipped);
+        }
+        if (cooked)
+            return images;
+
+        images.assign(files.size(), DecodedImage());
+        for (size_t i = 0; i < files.size(); i++)
+        {
+            DecodedImage &image = images[i];
+            image.path = files[i];
+            image.pixels = stbi_load(files[i].c_str(), &image.width, &image.height, &image.channels, 0);
+            if (!image.pixels)
+            {
+                std::cout << "Texture failed to load at path: " << files[i] << std::endl;
+                freeImages(images);
+                return vector<DecodedImage>();
+            }
+        }
+        return images;
+    }
+
+    void releaseJobs()
+    {
+        for (Job &job : jobs)
+        {
+            if (job.decode.valid())
+                freeImages(job.decode.get());
+            freeImages(job.images);
+        }
+        jobs.clear();
+    }
+
+    static void freeImages(vector<DecodedImage> &images)
+    {
+        for (DecodedImage &image : images)
+            stbi_image_free(image.pixels);
+        images.clear();
+    }
+
+    static void freeImages(vector<DecodedImage> &&images)
+    {
+        freeImages(images);
+    }
+
+    static GLenum formatFor(int channels)
+    {
+        if (channels == 1)
+            return GL_RED;
+        if (channels == 2)
+            return GL_RG;
+        if (channels == 3)
+            return GL_RGB;
+        return GL_RGBA;
+    }
+
+    // has to be asked on the GL thread, the answer is remembered
+    static bool compressedTexturesSupported()
+    {
+        static int supported = -1;
+        if (supported < 0)
+        {
+            supported = 0;
+            GLint count = 0;
+            glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+            for (GLint i = 0; i < count && !supported; i++)
+            {
+                const char *extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+                supported = extension && strcmp(extension, "GL_EXT_texture_compression_s3tc") == 0;
+            }
+        }
+        return supported == 1;
+    }
+
+    static size_t residentBytes(const Job &job)
+    {
+        size_t bytes = 0;
+        for (const DecodedImage &image : job.images)
+        {
+            if (image.isCooked())
+                bytes += image.size(); // the whole mip chain is in the file
+            else
+                bytes += job.sampling.usesMipmaps() ? image.size() + image.size() / 3 : image.size();
+        }
+        return bytes;
+    }
+
+    // checks without blocking whether the next count buffers of the ring are done being read by the GPU
+    bool uploadBuffersFree(size_t count)
+    {
+        if (uploadBuffers.empty())
+        {
+            uploadBuffers.resize(TEXTURE_UPLOAD_BUFFERS);
+            for (UploadBuffer &buffer : uploadBuffers)
+                glGenBuffers(1, &buffer.id);
+        }
+        for (size_t i = 0; i < count && i < uploadBuffers.size(); i++)
+        {
+            UploadBuffer &buffer = uploadBuffers[(nextUploadBuffer + i) % uploadBuffers.size()];
+            if (!buffer.fence)
+                continue;
+            GLenum status = glClientWaitSync(buffer.fence, 0, 0);
+            if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+                return false;
+            glDeleteSync(buffer.fence);
+            buffer.fence = nullptr;
+        }
+        return true;
+    }
+
+    void upload(const Job &job)
+    {
+        renderState().BindTexture(job.target, job.texture);
+        for (size_t i = 0; i < job.images.size(); i++)
+        {
+            const DecodedImage &image = job.images[i];
+            UploadBuffer &buffer = uploadBuffers[nextUploadBuffer];
+            nextUploadBuffer = (nextUploadBuffer + 1) % uploadBuffers.size();
+            if (buffer.fence)
+            {
+                // more faces than buffers in the ring, this one has to be waited for
+                glClientWaitSync(buffer.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+                glDeleteSync(buffer.fence);
+                buffer.fence = nullptr;
+            }
+
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer.id);
+            if (buffer.capacity < image.size())
+            {
+                buffer.capacity = image.size();
+                glBufferData(GL_PIXEL_UNPACK_BUFFER, buffer.capacity, nullptr, GL_STREAM_DRAW);
+            }
+            void *mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, image.size(), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+            if (!mapped)
+                continue;
+            memcpy(mapped, image.isCooked() ? image.cooked.data.data() : image.pixels, image.size());
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+            // the pixels come from the bound unpack buffer, so these return without waiting for the copy
+            GLenum target = job.target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + (GLenum)i : job.target;
+            if (image.isCooked())
+            {
+                GLenum format = image.cooked.format == COOKED_FORMAT_BC1 ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+                for (size_t level = 0; level < image.cooked.levels.size(); level++)
+                {
+                    const CookedLevel &cookedLevel = image.cooked.levels[level];
+                    glCompressedTexImage2D(target, (GLint)level, format, cookedLevel.width, cookedLevel.height, 0,
+                                           (GLsizei)cookedLevel.size, (void*)(uintptr_t)cookedLevel.offset);
+                }
+                glTexParameteri(job.target, GL_TEXTURE_MAX_LEVEL, (GLint)image.cooked.levels.size() - 1);
+            }
+            else
+            {
+                GLenum format = formatFor(image.channels);
+                glTexImage2D(target, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, nullptr);
+            }
+            buffer.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        // cooked images bring their own prebuilt mip chain
+        if (job.sampling.usesMipmaps() && !job.images.front().isCooked())
+            glGenerateMipmap(job.target);
+    }
+};
+
+// streamer shared by the model and scene texture loaders
+inline TextureStreamer &textureStreamer()
+{
+    static TextureStreamer streamer;
+    return streamer;
+}
+#endif
@@ -0,0 +1,108 @@
+#version 330 core
+// the directional light of the deferred path over the whole screen, drawn with hiz_downsample.vs's fullscreen
+// triangle. The same lighting as CalcDirLight in object_lighting.fs, from the G-buffer of gbuffer.fs
+out vec4 FragColor;
+
+struct DirLight {
+    vec3 direction;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+struct PointLight {
+    vec3 position;
+    float constant;
+    vec3 ambient;
+    float linear;
+    vec3 diffuse;
+    float quadratic;
+    vec3 specular;
+};
+
+struct SpotLight {
+    vec3 position;
+    float cutOff;
+    vec3 direction;
+    float outerCutOff;
+    vec3 ambient;
+    float constant;
+    vec3 diffuse;
+    float linear;
+    vec3 specular;
+    float quadratic;
+};
+
+#define NR_POINT_LIGHTS 2
+#define NR_SPOTLIGHTS 2
+
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+    mat4 skyboxView;
+    vec3 viewPos;
+    float currentFrame;
+    float maxViewDistance;
+};
+layout (std140) uniform Lights {
+    DirLight dirLight;
+    PointLight pointLights[NR_POINT_LIGHTS];
+    SpotLight spotLights[NR_SPOTLIGHTS];
+};
+
+uniform sampler2D gAlbedoSpecular;
+uniform sampler2D gNormal;
+uniform sampler2D gDepth;
+uniform mat4 inverseViewProjection;
+uniform vec2 screenSize;
+uniform float shininess;
+
+vec2 signNotZero(vec2 v)
+{
+    return vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+vec3 decodeNormal(vec2 encoded)
+{
+    encoded = encoded * 2.0 - 1.0;
+    vec3 n = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * signNotZero(n.xy);
+    return normalize(n);
+}
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gDepth, pixel, 0).r;
+    // nothing was drawn here, the sky pass fills it
+    if (depth == 1.0)
+        discard;
+    vec4 position = inverseViewProjection * vec4(vec3(gl_FragCoord.xy / screenSize, depth) * 2.0 - 1.0, 1.0);
+    vec3 fragPos = position.xyz / position.w;
+
+    // the far-field darkening has taken the directional light to black past the view distance, the light volumes
+    // still add theirs on top
+    if (fragPos.y < 1.0 && length(fragPos) >= maxViewDistance)
+    {
+        FragColor = vec4(0.0, 0.0, 0.0, 1.0);
+        return;
+    }
+
+    vec4 albedoSpecular = texelFetch(gAlbedoSpecular, pixel, 0);
+    vec3 normal = decodeNormal(texelFetch(gNormal, pixel, 0).xy);
+    vec3 viewDir = normalize(viewPos - fragPos);
+
+    vec3 lightDir = normalize(-dirLight.direction);
+    float diff = max(dot(normal, lightDir), 0.0);
+    vec3 reflectDir = reflect(-lightDir, normal);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
+    vec3 result = dirLight.ambient * albedoSpecular.rgb + dirLight.diffuse * diff * albedoSpecular.rgb
+                  + dirLight.specular * spec * albedoSpecular.a;
+
+    if (fragPos.y < 1.0)
+        result *= 1.0 - pow(length(fragPos) / maxViewDistance, 1.75);
+
+    FragColor = vec4(result, 1.0);
+}
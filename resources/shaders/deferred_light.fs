@@ -0,0 +1,70 @@
+#version 330 core
+// adds one point or spot light to the pixels its volume covers, the same lighting as CalcPointLight and
+// CalcSpotLight in object_lighting.fs. Point lights come with cut offs below -1, so the cone never dims them
+out vec4 FragColor;
+
+flat in vec4 PositionRadius;
+flat in vec4 AmbientConstant;
+flat in vec4 DiffuseLinear;
+flat in vec4 SpecularQuadratic;
+flat in vec4 DirectionCutOff;
+flat in float OuterCutOff;
+
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+    mat4 skyboxView;
+    vec3 viewPos;
+    float currentFrame;
+    float maxViewDistance;
+};
+
+uniform sampler2D gAlbedoSpecular;
+uniform sampler2D gNormal;
+uniform sampler2D gDepth;
+uniform mat4 inverseViewProjection;
+uniform vec2 screenSize;
+uniform float shininess;
+
+vec2 signNotZero(vec2 v)
+{
+    return vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+vec3 decodeNormal(vec2 encoded)
+{
+    encoded = encoded * 2.0 - 1.0;
+    vec3 n = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * signNotZero(n.xy);
+    return normalize(n);
+}
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gDepth, pixel, 0).r;
+    vec4 position = inverseViewProjection * vec4(vec3(gl_FragCoord.xy / screenSize, depth) * 2.0 - 1.0, 1.0);
+    vec3 fragPos = position.xyz / position.w;
+
+    // the volume's back faces also cover surfaces in front of it
+    float distance = length(PositionRadius.xyz - fragPos);
+    if (distance > PositionRadius.w)
+        discard;
+
+    vec4 albedoSpecular = texelFetch(gAlbedoSpecular, pixel, 0);
+    vec3 normal = decodeNormal(texelFetch(gNormal, pixel, 0).xy);
+    vec3 viewDir = normalize(viewPos - fragPos);
+
+    vec3 lightDir = normalize(PositionRadius.xyz - fragPos);
+    float diff = max(dot(normal, lightDir), 0.0);
+    vec3 reflectDir = reflect(-lightDir, normal);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
+    float attenuation = 1.0 / (AmbientConstant.w + DiffuseLinear.w * distance + SpecularQuadratic.w * (distance * distance));
+    float theta = dot(lightDir, normalize(-DirectionCutOff.xyz));
+    float intensity = clamp((theta - OuterCutOff) / (DirectionCutOff.w - OuterCutOff), 0.0, 1.0);
+
+    vec3 result = AmbientConstant.rgb * albedoSpecular.rgb + DiffuseLinear.rgb * diff * albedoSpecular.rgb
+                  + SpecularQuadratic.rgb * spec * albedoSpecular.a;
+    FragColor = vec4(result * attenuation * intensity, 1.0);
+}
@@ -0,0 +1,37 @@
+#version 330 core
+// one point or spot light of the deferred path, drawn as a sphere around its reach (LightVolume in
+// include/learnopengl/deferred_renderer.h), one instance per light
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec4 aPositionRadius;
+layout (location = 2) in vec4 aAmbientConstant;
+layout (location = 3) in vec4 aDiffuseLinear;
+layout (location = 4) in vec4 aSpecularQuadratic;
+layout (location = 5) in vec4 aDirectionCutOff;
+layout (location = 6) in float aOuterCutOff;
+
+flat out vec4 PositionRadius;
+flat out vec4 AmbientConstant;
+flat out vec4 DiffuseLinear;
+flat out vec4 SpecularQuadratic;
+flat out vec4 DirectionCutOff;
+flat out float OuterCutOff;
+
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+    mat4 skyboxView;
+    vec3 viewPos;
+    float currentFrame;
+    float maxViewDistance;
+};
+
+void main()
+{
+    PositionRadius = aPositionRadius;
+    AmbientConstant = aAmbientConstant;
+    DiffuseLinear = aDiffuseLinear;
+    SpecularQuadratic = aSpecularQuadratic;
+    DirectionCutOff = aDirectionCutOff;
+    OuterCutOff = aOuterCutOff;
+    gl_Position = projection * view * vec4(aPositionRadius.xyz + aPos * aPositionRadius.w, 1.0);
+}
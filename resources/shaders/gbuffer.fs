@@ -0,0 +1,50 @@
+#version 330 core
+// the G-buffer of the deferred path, drawn with object_lighting.vs and read by deferred_directional.fs and
+// deferred_light.fs: albedo with the specular intensity in alpha, and the normal in octahedral encoding
+layout (location = 0) out vec4 gAlbedoSpecular;
+layout (location = 1) out vec2 gNormal;
+
+struct Material {
+    sampler2D diffuse;
+    sampler2D specular;
+    float shininess;
+};
+
+in vec3 FragPos;
+in vec3 Normal;
+in vec2 TexCoords;
+// level of detail cross-fade, dithered like in object_lighting.fs
+flat in float LodFade;
+
+uniform Material material;
+
+// ordered 4x4 dither thresholds
+const float bayer[16] = float[16](0.0, 8.0, 2.0, 10.0, 12.0, 4.0, 14.0, 6.0, 3.0, 11.0, 1.0, 9.0, 15.0, 7.0, 13.0, 5.0);
+
+vec2 signNotZero(vec2 v)
+{
+    return vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+// the unit normal projected onto the octahedron and the lower half folded over the upper, in [0, 1]
+vec2 encodeNormal(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 folded = n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * signNotZero(n.xy);
+    return folded * 0.5 + 0.5;
+}
+
+void main()
+{
+    if (LodFade != 0.0)
+    {
+        ivec2 pixel = ivec2(gl_FragCoord.xy) & 3;
+        float threshold = (bayer[pixel.y * 4 + pixel.x] + 0.5) / 16.0;
+        if (LodFade > 0.0 ? threshold < LodFade : threshold >= -LodFade)
+            discard;
+    }
+
+    // the specular maps are grey, one channel of them is kept
+    gAlbedoSpecular = vec4(texture(material.diffuse, TexCoords).rgb, dot(texture(material.specular, TexCoords).rgb, vec3(1.0 / 3.0)));
+    gNormal = encodeNormal(normalize(Normal));
+}
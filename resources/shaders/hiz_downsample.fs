@@ -0,0 +1,30 @@
+#version 330 core
+// one texel of a depth pyramid level from the previous level, which is the only level the texture exposes while
+// this runs. Keeps the farthest depth, so a box behind that depth is behind everything the texel covers.
+
+uniform sampler2D depth;
+uniform vec2 previousSize;
+
+float fetch(ivec2 texel)
+{
+    return texelFetch(depth, min(texel, ivec2(previousSize) - 1), 0).r;
+}
+
+void main()
+{
+    ivec2 size = ivec2(previousSize);
+    ivec2 texel = ivec2(gl_FragCoord.xy) * 2;
+    float farthest = max(max(fetch(texel), fetch(texel + ivec2(1, 0))),
+                         max(fetch(texel + ivec2(0, 1)), fetch(texel + ivec2(1, 1))));
+
+    // a level is half the size rounded down, so after an odd size the last column and row also take the one left over
+    bool extraColumn = (size.x & 1) != 0 && texel.x == size.x - 3;
+    bool extraRow = (size.y & 1) != 0 && texel.y == size.y - 3;
+    if (extraColumn)
+        farthest = max(farthest, max(fetch(texel + ivec2(2, 0)), fetch(texel + ivec2(2, 1))));
+    if (extraRow)
+        farthest = max(farthest, max(fetch(texel + ivec2(0, 2)), fetch(texel + ivec2(1, 2))));
+    if (extraColumn && extraRow)
+        farthest = max(farthest, fetch(texel + ivec2(2, 2)));
+    gl_FragDepth = farthest;
+}
@@ -0,0 +1,9 @@
+#version 330 core
+out vec4 FragColor;
+
+flat in float visible;
+
+void main()
+{
+    FragColor = vec4(visible);
+}
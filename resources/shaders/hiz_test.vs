@@ -0,0 +1,55 @@
+#version 330 core
+// one point per world space box, drawn into texel gl_VertexID of the results texture: 1 when the box may be
+// visible, 0 when the depth pyramid shows it is behind what was drawn
+layout (location = 0) in vec3 boxMin;
+layout (location = 1) in vec3 boxMax;
+
+flat out float visible;
+
+uniform mat4 viewProjection;
+uniform sampler2D hiZ;
+uniform vec2 depthSize;     // of level 0
+uniform int maxLevel;
+uniform vec2 resultsSize;
+
+float testBox()
+{
+    vec3 ndcMin = vec3(1e30), ndcMax = vec3(-1e30);
+    for (int i = 0; i < 8; i++) {
+        vec3 corner = vec3((i & 1) != 0 ? boxMax.x : boxMin.x,
+                           (i & 2) != 0 ? boxMax.y : boxMin.y,
+                           (i & 4) != 0 ? boxMax.z : boxMin.z);
+        vec4 clip = viewProjection * vec4(corner, 1.0);
+        // a box reaching behind the camera has no screen rectangle, it counts as visible
+        if (clip.w <= 0.0)
+            return 1.0;
+        vec3 ndc = clip.xyz / clip.w;
+        ndcMin = min(ndcMin, ndc);
+        ndcMax = max(ndcMax, ndc);
+    }
+    // cut by the near plane, or off screen where nothing was drawn to hide it
+    if (ndcMin.z < -1.0 || any(greaterThan(ndcMin.xy, vec2(1.0))) || any(lessThan(ndcMax.xy, vec2(-1.0))))
+        return 1.0;
+
+    ivec2 size = ivec2(depthSize);
+    ivec2 first = clamp(ivec2(floor((ndcMin.xy * 0.5 + 0.5) * depthSize)), ivec2(0), size - 1);
+    ivec2 last = clamp(ivec2(floor((ndcMax.xy * 0.5 + 0.5) * depthSize)), ivec2(0), size - 1);
+    // at this level the rectangle spans at most two texels each way
+    ivec2 extent = last - first + 1;
+    int level = min(maxLevel, int(ceil(log2(float(max(extent.x, extent.y))))));
+    ivec2 levelLast = textureSize(hiZ, level) - 1;
+    first = min(first >> level, levelLast);
+    last = min(last >> level, levelLast);
+    float farthest = max(max(texelFetch(hiZ, first, level).r, texelFetch(hiZ, ivec2(last.x, first.y), level).r),
+                         max(texelFetch(hiZ, ivec2(first.x, last.y), level).r, texelFetch(hiZ, last, level).r));
+    // the small bias keeps surfaces lying on their own box from hiding it after the depth buffer's rounding
+    float nearest = ndcMin.z * 0.5 + 0.5;
+    return nearest <= farthest + 1e-6 ? 1.0 : 0.0;
+}
+
+void main()
+{
+    visible = testBox();
+    vec2 texel = vec2(gl_VertexID % int(resultsSize.x), gl_VertexID / int(resultsSize.x)) + 0.5;
+    gl_Position = vec4(texel / resultsSize * 2.0 - 1.0, 0.0, 1.0);
+}
@@ -2,15 +2,25 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+layout (location = 5) in mat4 aInstanceModel;
 
 out vec2 TexCoords;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// instanced draws take the model matrix from aInstanceModel
+uniform bool instanced;
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+    mat4 skyboxView;
+    vec3 viewPos;
+    float currentFrame;
+    float maxViewDistance;
+};
 
 void main()
 {
     TexCoords = aTexCoords;
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    mat4 world = instanced ? aInstanceModel : model;
+    gl_Position = projection * view * world * vec4(aPos, 1.0);
 }
\ No newline at end of file
@@ -7,6 +7,8 @@ struct Material {
     float shininess;
 };
 
+// the light structs are laid out for std140, each float fills the slot after a vec3.
+// LightsBlock in include/learnopengl/scene_uniforms.h mirrors them
 struct DirLight {
     vec3 direction;
 
@@ -17,29 +19,25 @@ struct DirLight {
 
 struct PointLight {
     vec3 position;
-
     float constant;
-    float linear;
-    float quadratic;
-
     vec3 ambient;
+    float linear;
     vec3 diffuse;
+    float quadratic;
     vec3 specular;
 };
 
 struct SpotLight {
     vec3 position;
-    vec3 direction;
     float cutOff;
+    vec3 direction;
     float outerCutOff;
-
-    float constant;
-    float linear;
-    float quadratic;
-
     vec3 ambient;
+    float constant;
     vec3 diffuse;
+    float linear;
     vec3 specular;
+    float quadratic;
 };
 
 #define NR_POINT_LIGHTS 2
@@ -48,11 +46,23 @@ struct SpotLight {
 in vec3 FragPos;
 in vec3 Normal;
 in vec2 TexCoords;
-
-uniform vec3 viewPos;
-uniform DirLight dirLight;
-uniform PointLight pointLights[NR_POINT_LIGHTS];
-uniform SpotLight spotLights[NR_SPOTLIGHTS];
+// level of detail cross-fade of the instance, see LodTransition: 0 draws it whole, the outgoing level carries the
+// fade and the incoming one its negation, so between them every pixel is drawn exactly once
+flat in float LodFade;
+
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+    mat4 skyboxView;
+    vec3 viewPos;
+    float currentFrame;
+    float maxViewDistance;
+};
+layout (std140) uniform Lights {
+    DirLight dirLight;
+    PointLight pointLights[NR_POINT_LIGHTS];
+    SpotLight spotLights[NR_SPOTLIGHTS];
+};
 uniform Material material;
 
 // function prototypes
@@ -60,8 +70,19 @@ vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir, vec3 FragPos);
 vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
 vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
 
+// ordered 4x4 dither thresholds
+const float bayer[16] = float[16](0.0, 8.0, 2.0, 10.0, 12.0, 4.0, 14.0, 6.0, 3.0, 11.0, 1.0, 9.0, 15.0, 7.0, 13.0, 5.0);
+
 void main()
 {
+    if (LodFade != 0.0)
+    {
+        ivec2 pixel = ivec2(gl_FragCoord.xy) & 3;
+        float threshold = (bayer[pixel.y * 4 + pixel.x] + 0.5) / 16.0;
+        if (LodFade > 0.0 ? threshold < LodFade : threshold >= -LodFade)
+            discard;
+    }
+
     // properties
     vec3 norm = normalize(Normal);
     vec3 viewDir = normalize(viewPos - FragPos);
@@ -87,6 +108,12 @@ void main()
 // calculates the color when using a directional light.
 vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir, vec3 FragPos)
 {
+    // the far-field darkening fades it out below y = 1, from the view distance on it is not worth evaluating;
+    // the point and spot lights still reach there
+    float fade = FragPos.y < 1.0 ? 1.0 - pow(length(FragPos) / maxViewDistance, 1.75) : 1.0;
+    if (fade <= 0.0)
+        return vec3(0.0);
+
     vec3 lightDir = normalize(-light.direction);
     // diffuse shading
     float diff = max(dot(normal, lightDir), 0.0);
@@ -98,17 +125,7 @@ vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir, vec3 FragPos)
     vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, TexCoords));
     vec3 specular = light.specular * spec * vec3(texture(material.specular, TexCoords));
 
-    vec3 result = ambient + diffuse + specular;
-
-    if(FragPos.y < 1.0){
-        float dist = length(FragPos);
-
-        result.x -= (result.x*pow(dist,1.75))/940.0;
-        result.y -= (result.y*pow(dist,1.75))/940.0;
-        result.z -= (result.z*pow(dist,1.75))/940.0;
-
-        if(dist>50.0) result = vec3(0.0, 0.0, 0.0);
-    }
+    vec3 result = (ambient + diffuse + specular) * fade;
 
     return (result);
 }
@@ -2,20 +2,36 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+layout (location = 5) in mat4 aInstanceModel;
+layout (location = 9) in mat3 aInstanceNormal;
+layout (location = 12) in float aInstanceFade;
 
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoords;
+flat out float LodFade;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// transpose(inverse(mat3(model))), computed once on the CPU
+uniform mat3 normalMatrix;
+// instanced draws take both matrices from aInstanceModel and aInstanceNormal
+uniform bool instanced;
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+    mat4 skyboxView;
+    vec3 viewPos;
+    float currentFrame;
+    float maxViewDistance;
+};
 
 void main()
 {
-    FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;
+    mat4 world = instanced ? aInstanceModel : model;
+    FragPos = vec3(world * vec4(aPos, 1.0));
+    Normal = (instanced ? aInstanceNormal : normalMatrix) * aNormal;
     TexCoords = aTexCoords;
+    LodFade = instanced ? aInstanceFade : 0.0;
 
     gl_Position = projection * view * vec4(FragPos, 1.0);
 }
\ No newline at end of file
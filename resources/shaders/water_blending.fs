@@ -5,24 +5,33 @@ in vec3 FragPos;
 in vec2 TexCoords;
 
 uniform sampler2D texture1;
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+    mat4 skyboxView;
+    vec3 viewPos;
+    float currentFrame;
+    float maxViewDistance;
+};
 
 void main()
 {
+    // distance darkening, black from the view distance on, where the texture is not worth fetching
+    float dist = length(FragPos);
+    if (dist >= maxViewDistance)
+    {
+        FragColor = vec4(0.0, 0.0, 0.0, 0.8);
+        return;
+    }
+
     vec4 result = texture(texture1, TexCoords);
     result.w = 0.8;
 
-    // distance darkening
-    float dist = length(FragPos);
-
     //result.x -= (result.x*dist)/50.0;
     //result.y -= (result.y*dist)/50.0;
     //result.z -= (result.z*dist)/50.0;
 
-    result.x -= (result.x*pow(dist,1.75))/940.0;
-    result.y -= (result.y*pow(dist,1.75))/940.0;
-    result.z -= (result.z*pow(dist,1.75))/940.0;
-
-    if(dist>50.0) result = vec4(0.0, 0.0, 0.0, 0.8);
+    result.xyz *= 1.0 - pow(dist / maxViewDistance, 1.75);
 
     FragColor = vec4(result);
 }
\ No newline at end of file
@@ -1,13 +1,31 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec2 aTexCoords;
+// per-instance placement: xyz position and yaw, then pitch and scale
+layout (location = 2) in vec4 aInstance;
+layout (location = 3) in vec2 aInstanceShape;
 
 out vec2 TexCoords;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-uniform float currentFrame;
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+    mat4 skyboxView;
+    vec3 viewPos;
+    float currentFrame;
+    float maxViewDistance;
+};
+
+// model matrix of the instance, translate(position) * rotateY(yaw) * scale(scale) * rotateX(pitch)
+// as laid out by QuadInstance in include/learnopengl/quad_instances.h
+mat4 instanceModel()
+{
+    float cy = cos(aInstance.w), sy = sin(aInstance.w);
+    float cx = cos(aInstanceShape.x), sx = sin(aInstanceShape.x);
+    mat3 rotation = mat3(cy, 0.0, -sy, 0.0, 1.0, 0.0, sy, 0.0, cy) * mat3(1.0, 0.0, 0.0, 0.0, cx, sx, 0.0, -sx, cx);
+    mat3 basis = rotation * aInstanceShape.y;
+    return mat4(vec4(basis[0], 0.0), vec4(basis[1], 0.0), vec4(basis[2], 0.0), vec4(aInstance.xyz, 1.0));
+}
 
 void main()
 {
@@ -15,5 +33,5 @@ void main()
 
     TexCoords.y = aTexCoords.y - 3*currentFrame;
     TexCoords.x = aTexCoords.x + sin(currentFrame)/3;
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    gl_Position = projection * view * instanceModel() * vec4(aPos, 1.0);
 }
\ No newline at end of file
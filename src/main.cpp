@@ -11,9 +11,23 @@
 #include <learnopengl/filesystem.h>
 #include <learnopengl/shader_m.h>
 #include <learnopengl/camera.h>
+#include <learnopengl/bvh.h>
+#include <learnopengl/deferred_renderer.h>
+#include <learnopengl/lod_selection.h>
 #include <learnopengl/model.h>
+#include <learnopengl/model_loader.h>
+#include <learnopengl/occlusion_culling.h>
+#include <learnopengl/quad_instances.h>
+#include <learnopengl/render_queue.h>
+#include <learnopengl/scene_file.h>
+#include <learnopengl/scene_graph.h>
+#include <learnopengl/scene_uniforms.h>
+#include <learnopengl/texture_registry.h>
+#include <learnopengl/texture_streamer.h>
 
 #include <iostream>
+#include <map>
+#include <memory>
 
 void framebuffer_size_callback(GLFWwindow *window, int width, int height);
 
@@ -47,6 +61,11 @@ struct ProgramState {
     Camera camera;
     bool CameraMouseMovementUpdateEnabled = true;
     bool spotlight = false;
+    bool occlusionCulling = true;
+    // lit models go through the G-buffer and every lantern lights them, instead of the two nearest in object_lighting.fs
+    bool deferredShading = false;
+    // the largest simplification error, in pixels, a level of detail may show on screen
+    float lodPixelError = 1.0f;
     ProgramState()
             : camera(glm::vec3(0.0f, 0.0f, 3.0f)) {}
 
@@ -55,6 +74,8 @@ struct ProgramState {
     glm::vec3 tempPosition=glm::vec3(0.0f, 2.0f, 0.0f);
     float tempScale=1.0f;
     float tempRotation=0.0f;
+    // grass cards per hand placed tuft
+    int grassDensity=1;
 };
 
 void ProgramState::SaveToFile(std::string filename) {
@@ -71,7 +92,8 @@ void ProgramState::SaveToFile(std::string filename) {
         << tempPosition.y << '\n'
         << tempPosition.z << '\n'
         << tempScale << '\n'
-        << tempRotation << '\n';
+        << tempRotation << '\n'
+        << grassDensity << '\n';
 }
 
 void ProgramState::LoadFromFile(std::string filename) {
@@ -89,13 +111,26 @@ void ProgramState::LoadFromFile(std::string filename) {
            >> tempPosition.y
            >> tempPosition.z
            >> tempScale
-           >> tempRotation;
+           >> tempRotation
+           >> grassDensity;
     }
 }
 
 ProgramState *programState;
 
-void DrawImGui(ProgramState *programState);
+// what the scene queries found this frame, shown in the camera window
+struct SceneQueryStats {
+    unsigned int visible = 0;
+    unsigned int culled = 0;
+    unsigned int occluded = 0;  // in the frustum but hidden in the last depth pyramid
+    unsigned int lit = 0;       // objects in reach of a lantern's point light
+    unsigned int lights = 0;    // point and spot lights the deferred path drew
+    unsigned int triangles = 0;     // of the scene models drawn, at the levels of detail they were drawn with
+    unsigned int fullTriangles = 0; // the same models all at their full level
+    std::string picked;         // the model the camera looks at
+};
+
+void DrawImGui(ProgramState *programState, const SceneQueryStats &queryStats);
 
 int main() {
     // glfw: initialize and configure
@@ -131,12 +166,14 @@ int main() {
         return -1;
     }
 
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    renderState().Enable(GL_DEPTH_TEST);
+    renderState().Enable(GL_BLEND);
+    renderState().BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    // the skybox is mipmapped, filter across cube face edges so the seams don't show in the smaller levels
+    glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
 
     // tell stb_image.h to flip loaded texture's on the y-axis (before loading model).
-    stbi_set_flip_vertically_on_load(true);
+    textureStreamer().SetFlipVertically(true);
 
     programState = new ProgramState;
     programState->LoadFromFile("resources/program_state.txt");
@@ -152,9 +189,6 @@ int main() {
     ImGui_ImplGlfw_InitForOpenGL(window, true);
     ImGui_ImplOpenGL3_Init("#version 330 core");
 
-    // configure global opengl state
-    glEnable(GL_DEPTH_TEST);
-
     // build and compile shaders
     Shader objShader("resources/shaders/object_lighting.vs", "resources/shaders/object_lighting.fs");
     Shader waterShader("resources/shaders/water_blending.vs", "resources/shaders/water_blending.fs");
@@ -163,28 +197,76 @@ int main() {
     Shader discardShader("resources/shaders/discard_shader.vs", "resources/shaders/discard_shader.fs");
     Shader waterfallShader("resources/shaders/waterfall_shader.vs", "resources/shaders/waterfall_shader.fs");
     Shader rippleShader("resources/shaders/ripple_shader.vs", "resources/shaders/ripple_shader.fs");
-
-    // load models
-    Model bard("resources/objects/sleepy_bard/sleepy_bard.obj");
-    bard.SetShaderTextureNamePrefix("material.");
-    Model island("resources/objects/island/island_with_decor.obj");
-    island.SetShaderTextureNamePrefix("material.");
-    Model mountain_island("resources/objects/mountain_island/mountain.obj");
-    mountain_island.SetShaderTextureNamePrefix("material.");
-    Model sand_terrain("resources/objects/sand_terrain/sand_terrain.obj");
-    sand_terrain.SetShaderTextureNamePrefix("material.");
-    Model support_beam("resources/objects/support_beam/support_beam.obj");
-    support_beam.SetShaderTextureNamePrefix("material.");
-    Model chinese_lantern("resources/objects/chinese_lantern/chinese_lantern.obj");
-    chinese_lantern.SetShaderTextureNamePrefix("material.");
-    Model boat("resources/objects/boat/boat.obj");
-    boat.SetShaderTextureNamePrefix("material.");
-    Model barrel("resources/objects/barrel/barrel.obj");
-    barrel.SetShaderTextureNamePrefix("material.");
-    Model cliffs("resources/objects/cliffs/cliffs.obj");
-    cliffs.SetShaderTextureNamePrefix("material.");
-    Model granite("resources/objects/granite/granite.obj");
-    cliffs.SetShaderTextureNamePrefix("material.");
+    Shader hiZDownsampleShader("resources/shaders/hiz_downsample.vs", "resources/shaders/hiz_downsample.fs");
+    Shader hiZTestShader("resources/shaders/hiz_test.vs", "resources/shaders/hiz_test.fs");
+    Shader gBufferShader("resources/shaders/object_lighting.vs", "resources/shaders/gbuffer.fs");
+    Shader deferredDirectionalShader("resources/shaders/hiz_downsample.vs", "resources/shaders/deferred_directional.fs");
+    Shader deferredLightShader("resources/shaders/deferred_light.vs", "resources/shaders/deferred_light.fs");
+    // set once per drawn object, so resolved up front
+    TransformUniforms objTransformUniforms = transformUniforms(objShader);
+    TransformUniforms gBufferTransformUniforms = transformUniforms(gBufferShader);
+    Uniform rippleModelUniform = rippleShader.uniform("model");
+    Uniform waterModelUniform = waterShader.uniform("model");
+    RenderQueue renderQueue;
+
+    // camera and lights are shared by every program through uniform blocks, written once per frame
+    SceneUniforms sceneUniforms;
+    for (const Shader *shader : {&objShader, &waterShader, &skyboxShader, &sourceShader, &discardShader, &waterfallShader, &rippleShader,
+                                 &gBufferShader, &deferredDirectionalShader, &deferredLightShader})
+        sceneUniforms.Bind(*shader);
+
+    LightsBlock &lights = sceneUniforms.lights;
+    skyboxShader.use();
+    skyboxShader.setInt("skybox", 0);
+
+    // placements, lights and emitters come from the scene file, the text is parsed once and read from its
+    // binary variant afterwards
+    const std::string scenePath = FileSystem::getPath("resources/scenes/lake.scene");
+    SceneDescription sceneFile;
+    if (!loadScene(scenePath, sceneFile)) {
+        std::cout << "Failed to load scene " << scenePath << std::endl;
+        glfwTerminate();
+        return -1;
+    }
+    SceneFileWatcher sceneWatcher(scenePath);
+
+    // models by path and vertex format, kept across reloads so editing the scene never imports a model twice
+    std::map<std::string, std::unique_ptr<Model>> loadedModels;
+    // by index of the scene's model statements
+    vector<Model*> sceneModels;
+    vector<Shader*> sceneModelShaders;
+    vector<TransformUniforms> sceneModelUniforms;
+    TransformUniforms sourceTransformUniforms = transformUniforms(sourceShader);
+    auto loadSceneModels = [&]() {
+        // the imports run in parallel on the worker pool and only the uploads happen here
+        ModelLoader modelLoader;
+        vector<Model*> added;
+        sceneModels.clear();
+        sceneModelShaders.clear();
+        sceneModelUniforms.clear();
+        for (const SceneModel &entry : sceneFile.models) {
+            std::unique_ptr<Model> &model = loadedModels[entry.path + (entry.format == VertexFormat::Packed ? "|packed" : "")
+                                                         + (entry.lodLevels > 1 ? "|lod" : "")];
+            if (!model) {
+                model.reset(new Model());
+                model->lodLevels = entry.lodLevels;
+                modelLoader.Add(*model, entry.path, entry.format);
+                added.push_back(model.get());
+            }
+            bool emissive = entry.shader == SceneShader::Emissive;
+            sceneModels.push_back(model.get());
+            sceneModelShaders.push_back(emissive ? &sourceShader : &objShader);
+            sceneModelUniforms.push_back(emissive ? sourceTransformUniforms : objTransformUniforms);
+        }
+        if (added.empty())
+            return;
+        double modelLoadMillis = modelLoader.Finish();
+        printModelLoadReport();
+        std::cout << "Loaded " << added.size() << " models in " << modelLoadMillis << " ms on " << modelLoader.ThreadCount() << " worker threads" << std::endl;
+        for (Model *model : added)
+            model->SetShaderTextureNamePrefix("material.");
+    };
+    loadSceneModels();
 
     // set up vertex data (and buffer(s)) and configure vertex attributes
     // ------------------------------------------------------------------
@@ -353,424 +435,422 @@ int main() {
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)nullptr);
 
-    // load textures
-    // -------------
-    unsigned int diffuseMap = loadTexture(FileSystem::getPath("resources/textures/water_dark.png").c_str());
-    unsigned int transparentTexture = loadTexture(FileSystem::getPath("resources/textures/grass.png").c_str());
-    unsigned int waterfallTexture = loadTexture(FileSystem::getPath("resources/textures/seamless waterfall.jpeg").c_str());
-    unsigned int rippleTexture = loadTexture(FileSystem::getPath("resources/textures/ripple.jpg").c_str());
-
-
-    // transparent window locations
-    // --------------------------------
-    vector<glm::vec3> waterSquares
-            {
-                    glm::vec3(-25.0f, 1.0f, -25.0f),
-                    glm::vec3(-25.0f, 1.0f, 25.0f),
-                    glm::vec3(25.0f, 1.0f, -25.0f),
-                    glm::vec3(25.0f, 1.0f, 25.0f)
-            };
     // draw in wireframe
     //glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
-    vector<std::string> faces
-            {
-                    FileSystem::getPath("resources/textures/skybox/front.png"),
-                    FileSystem::getPath("resources/textures/skybox/back.png"),
-                    FileSystem::getPath("resources/textures/skybox/top.png"),
-                    FileSystem::getPath("resources/textures/skybox/bottom.png"),
-                    FileSystem::getPath("resources/textures/skybox/left.png"),
-                    FileSystem::getPath("resources/textures/skybox/right.png")
-            };
-
-    vector<glm::vec3> vegetation
-            {
-                    glm::vec3(-1.5f, 1.5f, -0.48f),
-                    glm::vec3( 1.5f, 1.5f, 0.51f),
-                    glm::vec3( 0.0f, 1.5f, 0.7f),
-                    glm::vec3(-0.7f, 1.5f, -2.3f),
-                    glm::vec3 (1.0f, 1.5f, -1.2f),
-                    glm::vec3 (-0.1f, 1.5f, -0.63f),
-                    glm::vec3 (-1.75f, 1.5f, 1.0f),
-                    glm::vec3 (-0.6f, 1.5f, -2.0f)
-            };
-
-    vector<glm::vec3> waterfall_tiles
-            {
-                    glm::vec3( -0.8f, 1.12f, 1.0f),
-                    glm::vec3( -0.8f, 1.37f, 1.0f),
-                    glm::vec3( -0.8f, 1.62f, 1.0f),
-                    glm::vec3( -0.77f, 1.86f, 1.03f),
-                    glm::vec3( -0.66f, 2.03f, 1.14f),
-                    glm::vec3( -0.50f, 2.11f, 1.30f),
-                    glm::vec3( -0.33f, 2.13f, 1.47f)
-            };
-
-    unsigned int cubeMapTexture = loadCubeMap(faces);
+    // everything the scene file places, built again whenever the file changes
+    SceneGraph scene;
+    vector<vector<WorldTransform>> modelInstances;  // static placements, by scene model
+    vector<vector<WorldTransform>> visibleInstances, lanternInstances;
+    // level of detail of every placement, indexed like its box, and the placements of one model by level
+    vector<LodTransition> lodStates;
+    vector<vector<WorldTransform>> lodInstances(MAX_LOD_LEVELS);
+    vector<vector<float>> lodFades(MAX_LOD_LEVELS);
+    // world boxes of everything drawn, in a BVH for culling, picking and finding what the lanterns light. The
+    // placements come first in the order of modelInstances, then the water squares, then the lanterns, which
+    // move and are refit every frame
+    vector<Aabb> sceneBoxes;
+    vector<int> boxModels;      // scene model of every box, -1 for the water
+    Bvh sceneBvh;
+    // tests the same boxes against the depth of the previous frame
+    OcclusionCuller occlusion(hiZDownsampleShader, hiZTestShader);
+    // the G-buffer and light volumes of the deferred path, one volume per lantern light
+    DeferredRenderer deferred(deferredDirectionalShader, deferredLightShader);
+    vector<LightVolume> lightVolumes;
+    vector<uint8_t> visible, lit;
+    // boxes the far-field darkening paints black as a whole, left out like the ones outside the frustum while no
+    // lantern reaches them
+    vector<uint8_t> beyondView;
+    unsigned int waterBounds = 0, staticBounds = 0;
+    // the farthest any static box reaches from the origin, the far plane covers it from wherever the camera is
+    float staticReach = 0.0f;
+    SceneQueryStats queryStats;
+    vector<unsigned int> lanternSwings, lanterns, lanternBases;
+    unsigned int diffuseMap = 0, transparentTexture = 0, waterfallTexture = 0, rippleTexture = 0, cubeMapTexture = 0;
+    // the grass cards and waterfall tiles are instanced quads, their placement lives in buffers on the GPU
+    QuadInstanceBuffer grassInstances(transparentVAO2);
+    QuadInstanceBuffer waterfallInstances(waterfallVAO);
+    int uploadedGrassDensity = 0;
+
+    // textures are acquired before the old ones are released, so the ones the scene still uses stay loaded
+    auto replaceTexture = [](unsigned int &texture, const std::string &path) {
+        unsigned int replacement = path.empty() ? 0 : loadTexture(FileSystem::getPath(path).c_str());
+        if (texture != 0)
+            textureRegistry().Release(texture);
+        texture = replacement;
+    };
+
+    auto buildScene = [&]() {
+        // resolve the samplers of every model once, drawing then does no string work
+        for (unsigned int i = 0; i < sceneModels.size(); i++)
+            sceneModels[i]->BindShader(*sceneModelShaders[i]);
+
+        // the static objects get their world and normal matrices once here
+        scene = SceneGraph();
+        vector<vector<unsigned int>> modelNodes(sceneModels.size());
+        for (const SceneObject &object : sceneFile.objects)
+            modelNodes[object.model].push_back(scene.AddNode(object.local));
+
+        // the lanterns hang from a mount, swing around it and carry the base their spot light shines from
+        lanternSwings.clear();
+        lanterns.clear();
+        lanternBases.clear();
+        for (const SceneLantern &lantern : sceneFile.lanterns) {
+            unsigned int mount = scene.AddNode(glm::scale(glm::translate(glm::mat4(1.0f), lantern.mount), glm::vec3(lantern.scale)));
+            lanternSwings.push_back(scene.AddNode(glm::mat4(1.0f), mount));
+            lanterns.push_back(scene.AddNode(glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -lantern.length, 0.0f)), lanternSwings.back()));
+            lanternBases.push_back(scene.AddNode(glm::scale(glm::translate(glm::mat4(1.0f), lantern.base), glm::vec3(lantern.scale)), lanterns.back()));
+        }
+        scene.Update();
+
+        modelInstances.assign(sceneModels.size(), vector<WorldTransform>());
+        visibleInstances.assign(sceneModels.size(), vector<WorldTransform>());
+        lanternInstances.assign(sceneModels.size(), vector<WorldTransform>());
+        sceneBoxes.clear();
+        boxModels.clear();
+        for (unsigned int i = 0; i < sceneModels.size(); i++)
+            for (unsigned int node : modelNodes[i]) {
+                modelInstances[i].push_back(scene.Transform(node));
+                sceneBoxes.push_back(worldBox(sceneModels[i]->bounds, scene.Transform(node).model));
+                boxModels.push_back((int)i);
+            }
+        // a water square is a flat 50x50 quad
+        MeshBounds waterSquareBounds;
+        waterSquareBounds.min = glm::vec3(-25.0f, 0.0f, -25.0f);
+        waterSquareBounds.max = glm::vec3(25.0f, 0.0f, 25.0f);
+        waterSquareBounds.radius = glm::length(waterSquareBounds.max);
+        waterBounds = (unsigned int)sceneBoxes.size();
+        for (const glm::vec3 &waterSquare : sceneFile.waterSquares) {
+            sceneBoxes.push_back(worldBox(waterSquareBounds, glm::translate(glm::mat4(1.0f), waterSquare)));
+            boxModels.push_back(-1);
+        }
+        staticBounds = (unsigned int)sceneBoxes.size();
+        lodStates.assign(waterBounds, LodTransition());
+        for (unsigned int i = 0; i < lanterns.size(); i++) {
+            unsigned int model = sceneFile.lanterns[i].model;
+            sceneBoxes.push_back(worldBox(sceneModels[model]->bounds, scene.Transform(lanterns[i]).model));
+            boxModels.push_back((int)model);
+        }
+        sceneBvh.Build(sceneBoxes);
+        occlusion.Reset();
+        visible.assign(sceneBoxes.size(), 0);
+        lit.assign(sceneBoxes.size(), 0);
+        // past the view distance the lit program takes the directional light from what lies below y = 1. The
+        // water goes on being drawn, a black square over the sky, and the lanterns glow on their own
+        beyondView.assign(sceneBoxes.size(), 0);
+        staticReach = 0.0f;
+        for (unsigned int box = 0; box < staticBounds; box++) {
+            const Aabb &bounds = sceneBoxes[box];
+            bool darkened = boxModels[box] >= 0 && sceneModelShaders[boxModels[box]] == &objShader && bounds.max.y < 1.0f;
+            float nearest = glm::length(glm::clamp(glm::vec3(0.0f), bounds.min, bounds.max));
+            beyondView[box] = darkened && nearest >= sceneFile.viewDistance ? 1 : 0;
+            staticReach = std::max(staticReach, glm::length(glm::max(glm::abs(bounds.min), glm::abs(bounds.max))));
+        }
+
+        // every lantern carries one point and one spot light, the lights without a lantern stay dark
+        lights.dirLight = sceneFile.dirLight;
+        for (unsigned int i = 0; i < NR_POINT_LIGHTS; i++) {
+            lights.pointLights[i] = sceneFile.pointLight;
+            if (i >= lanterns.size())
+                lights.pointLights[i].ambient = lights.pointLights[i].diffuse = lights.pointLights[i].specular = glm::vec3(0.0f);
+        }
+        for (unsigned int i = 0; i < NR_SPOTLIGHTS; i++) {
+            lights.spotLights[i] = sceneFile.spotLight;
+            lights.spotLights[i].ambient = i < lanterns.size() ? sceneFile.spotLight.ambient : glm::vec3(0.0f);
+            lights.spotLights[i].diffuse = lights.spotLights[i].specular = glm::vec3(0.0f);
+        }
+        objShader.use();
+        objShader.setFloat("material.shininess", sceneFile.shininess);
+        deferred.SetShininess(sceneFile.shininess);
+
+        replaceTexture(diffuseMap, sceneFile.waterTexture);
+        replaceTexture(transparentTexture, sceneFile.grassTexture);
+        replaceTexture(waterfallTexture, sceneFile.waterfallTexture);
+        replaceTexture(rippleTexture, sceneFile.rippleTexture);
+        vector<std::string> faces;
+        for (const std::string &face : sceneFile.skyboxFaces)
+            faces.push_back(FileSystem::getPath(face));
+        unsigned int cubeMap = faces.empty() ? 0 : loadCubeMap(faces);
+        if (cubeMapTexture != 0)
+            textureRegistry().Release(cubeMapTexture);
+        cubeMapTexture = cubeMap;
+
+        waterfallInstances.Upload(sceneFile.waterfallTiles);
+        // the grass is scattered on the next frame
+        uploadedGrassDensity = 0;
+
+        // the loading above bound buffers and vertex arrays directly, from here on all state goes through the tracker
+        renderState().Invalidate();
+    };
+    buildScene();
 
     while (!glfwWindowShouldClose(window)) {
+        renderState().BeginFrame();
         float currentFrame = glfwGetTime();
         deltaTime = (float)currentFrame - lastFrame;
         lastFrame = (float)currentFrame;
 
+        // an edited scene file is loaded again, one with errors leaves the running scene as it is
+        if (sceneWatcher.Poll(currentFrame)) {
+            SceneDescription reloaded;
+            if (loadScene(scenePath, reloaded)) {
+                sceneFile = std::move(reloaded);
+                loadSceneModels();
+                buildScene();
+                std::cout << "Reloaded " << scenePath << std::endl;
+            }
+        }
+
         processInput(window);
+        textureStreamer().Update();
 
         glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        objShader.use();
-        objShader.setVec3("viewPos", programState->camera.Position);
-        objShader.setFloat("material.shininess", 32.0f);
-        objShader.setBool("celShading", true);
-        skyboxShader.setBool("celShading", true);
-        waterShader.setBool("celShading", true);
-        sourceShader.setBool("celShading", true);
-
-        glm::mat4 projection = glm::perspective(glm::radians(programState->camera.Zoom), (float) SCR_WIDTH / (float) SCR_HEIGHT, 0.1f, 100.0f);
-        glm::mat4 view = programState->camera.GetViewMatrix();
-        objShader.setMat4("projection", projection);
-        objShader.setMat4("view", view);
-
-        // transformation matrices for the lanterns and the lights
-
-        glm::mat4 transMat1 = glm::mat4(1.0f);
-        transMat1 = glm::translate(transMat1, glm::vec3(1.05f, 1.95f, -0.46f));
-        transMat1 = glm::scale(transMat1, glm::vec3(0.08f, 0.08f, 0.08f));
-        transMat1 = glm::rotate(transMat1, sin(currentFrame*2)*glm::radians(60.0f), glm::vec3(0,0,1));
-        transMat1 = glm::translate(transMat1, glm::vec3(0.0f, -3.0f, 0.0f));
-
-        glm::mat4 transMat2 = glm::mat4(1.0f);
-        transMat2 = glm::translate(transMat2, glm::vec3(-1.85f, 1.95f, 0.56f));
-        transMat2 = glm::scale(transMat2, glm::vec3(0.08f, 0.08f, 0.08f));
-        transMat2 = glm::rotate(transMat2, sin(0.6f+currentFrame*2)*glm::radians(60.0f), glm::vec3(0,0,1));
-        transMat2 = glm::translate(transMat2, glm::vec3(0.0f, -3.0f, 0.0f));
-
-        glm::mat4 baseMat1 = glm::mat4(1.0f);
-        baseMat1 = glm::translate(transMat1, glm::vec3(1.05f, 1.95f, 0.06f));
-        baseMat1 = glm::scale(baseMat1, glm::vec3(0.08f, 0.08f, 0.08f));
-        glm::mat4 baseMat2 = glm::mat4(1.0f);
-        baseMat2 = glm::translate(transMat2, glm::vec3(-1.85f, 1.95f, 1.16f));
-        baseMat2 = glm::scale(baseMat2, glm::vec3(0.08f, 0.08f, 0.08f));
-
-
-        glm::vec3 pos0 = transMat1 * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
-        glm::vec3 pos1 = transMat2 * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
-
-        glm::vec3 basePos0 = baseMat1 *  glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
-        glm::vec3 basePos1 = baseMat2 *  glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
-
-        glm::vec3 spotlight_vector1 = normalize(pos0 - basePos0);
-        glm::vec3 spotlight_vector2 = normalize(pos1 - basePos1);
-
-        // directional light
-
-        objShader.setVec3("dirLight.direction", -1.0f, -0.2f, 0.0f);
-        objShader.setVec3("dirLight.ambient", 0.05f, 0.05f, 0.20f);
-        objShader.setVec3("dirLight.diffuse", 0.4f, 0.4f, 0.6f);
-        objShader.setVec3("dirLight.specular", 0.5f, 0.5f, 0.7f);
-
-        // point light 1
-
-        objShader.setVec3("pointLights[0].position", pos0);
-        objShader.setVec3("pointLights[0].ambient", 0.10f, 0.05f, 0.05f);
-        objShader.setVec3("pointLights[0].diffuse", 0.8f, 0.6f, 0.6f);
-        objShader.setVec3("pointLights[0].specular", 1.0f, 1.0f, 0.0f);
-        objShader.setFloat("pointLights[0].constant", 1.0f);
-        objShader.setFloat("pointLights[0].linear", 0.09);
-        objShader.setFloat("pointLights[0].quadratic", 0.032);
-
-        // point light 2
-
-        objShader.setVec3("pointLights[1].position", pos1);
-        objShader.setVec3("pointLights[1].ambient", 0.10f, 0.05f, 0.05f);
-        objShader.setVec3("pointLights[1].diffuse", 0.8f, 0.6f, 0.6f);
-        objShader.setVec3("pointLights[1].specular", 1.0f, 1.0f, 0.0f);
-        objShader.setFloat("pointLights[1].constant", 1.0f);
-        objShader.setFloat("pointLights[1].linear", 0.09);
-        objShader.setFloat("pointLights[1].quadratic", 0.032);
-
-        // spotLight 1
-
-        objShader.setVec3("spotLights[0].position", basePos0);
-        objShader.setVec3("spotLights[0].direction", spotlight_vector1);
-        objShader.setVec3("spotLights[0].ambient", 0.0f, 0.0f, 0.0f);
-        if(programState->spotlight) {
-            objShader.setVec3("spotLights[0].diffuse", 1.0f, 1.0f, 1.0f);
-            objShader.setVec3("spotLights[0].specular", 1.0f, 1.0f, 1.0f);
+        // the lanterns swing, only their swing nodes change and the scene graph updates what hangs below them
+        for (unsigned int i = 0; i < lanternSwings.size(); i++)
+            scene.SetLocal(lanternSwings[i], glm::rotate(glm::mat4(1.0f), sin(sceneFile.lanterns[i].phase+currentFrame*2)*glm::radians(60.0f), glm::vec3(0,0,1)));
+        scene.Update();
+
+        // only the lanterns moved, the tree keeps its structure and just refits the boxes above them
+        float sceneReach = staticReach;
+        for (unsigned int i = 0; i < lanterns.size(); i++) {
+            sceneBoxes[staticBounds + i] = worldBox(sceneModels[sceneFile.lanterns[i].model]->bounds, scene.Transform(lanterns[i]).model);
+            sceneBvh.SetBox(staticBounds + i, sceneBoxes[staticBounds + i]);
+            sceneReach = std::max(sceneReach, glm::length(glm::max(glm::abs(sceneBoxes[staticBounds + i].min),
+                                                                   glm::abs(sceneBoxes[staticBounds + i].max))));
         }
-        else{
-            objShader.setVec3("spotLights[0].diffuse", 0.0f, 0.0f, 0.0f);
-            objShader.setVec3("spotLights[0].specular", 0.0f, 0.0f, 0.0f);
+        sceneBvh.Refit();
+
+        // the far plane lies past every box that can be drawn, seen from the camera
+        float farPlane = std::max(glm::length(programState->camera.Position) + sceneReach, 1.0f);
+        glm::mat4 projection = glm::perspective(glm::radians(programState->camera.Zoom), (float) SCR_WIDTH / (float) SCR_HEIGHT, 0.1f, farPlane);
+        glm::mat4 view = programState->camera.GetViewMatrix();
+        sceneUniforms.camera.view = view;
+        sceneUniforms.camera.projection = projection;
+        sceneUniforms.camera.skyboxView = glm::mat4(glm::mat3(view)); // remove translation from the view matrix
+        sceneUniforms.camera.viewPos = programState->camera.Position;
+        sceneUniforms.camera.currentFrame = currentFrame;
+        sceneUniforms.camera.maxViewDistance = sceneFile.viewDistance;
+
+        // lights follow the swinging lanterns, the spot lights are switched by dimming them to black
+        for (unsigned int i = 0; i < lanterns.size() && i < NR_POINT_LIGHTS && i < NR_SPOTLIGHTS; i++) {
+            glm::vec3 lanternPosition = scene.Position(lanterns[i]);
+            glm::vec3 basePosition = scene.Position(lanternBases[i]);
+            lights.pointLights[i].position = lanternPosition;
+            lights.spotLights[i].position = basePosition;
+            lights.spotLights[i].direction = normalize(lanternPosition - basePosition);
+            lights.spotLights[i].diffuse = programState->spotlight ? sceneFile.spotLight.diffuse : glm::vec3(0.0f);
+            lights.spotLights[i].specular = programState->spotlight ? sceneFile.spotLight.specular : glm::vec3(0.0f);
         }
-        objShader.setFloat("spotLights[0].constant", 1.0f);
-        objShader.setFloat("spotLights[0].linear", 0.09);
-        objShader.setFloat("spotLights[0].quadratic", 0.032);
-        objShader.setFloat("spotLights[0].cutOff", glm::cos(glm::radians(2.5f)));
-        objShader.setFloat("spotLights[0].outerCutOff", glm::cos(glm::radians(5.0f)));
-
-        // spotLight 2
-
-        objShader.setVec3("spotLights[1].position", basePos1);
-        objShader.setVec3("spotLights[1].direction", spotlight_vector2);
-        objShader.setVec3("spotLights[1].ambient", 0.0f, 0.0f, 0.0f);
-        if(programState->spotlight) {
-            objShader.setVec3("spotLights[1].diffuse", 1.0f, 1.0f, 1.0f);
-            objShader.setVec3("spotLights[1].specular", 1.0f, 1.0f, 1.0f);
+
+        // light assignment: the objects within reach of any lantern's point light or of the spot light at its base,
+        // switched on or not, since a switched off spot light still adds its ambient
+        std::fill(lit.begin(), lit.end(), 0);
+        queryStats.lit = 0;
+        auto markLit = [&](unsigned int box) {
+            queryStats.lit += lit[box] ? 0 : 1;
+            lit[box] = 1;
+        };
+        float lanternRange = pointLightRange(sceneFile.pointLight);
+        float spotRange = spotLightVolume(sceneFile.spotLight).radius;
+        for (unsigned int i = 0; i < lanterns.size(); i++) {
+            sceneBvh.QuerySphere(scene.Position(lanterns[i]), lanternRange, markLit);
+            sceneBvh.QuerySphere(scene.Position(lanternBases[i]), spotRange, markLit);
         }
-        else{
-            objShader.setVec3("spotLights[1].diffuse", 0.0f, 0.0f, 0.0f);
-            objShader.setVec3("spotLights[1].specular", 0.0f, 0.0f, 0.0f);
+
+        // everything outside the view frustum, or past the view distance and out of the lanterns' reach, is left out
+        // of the queue, and so is what the last depth pyramid showed hidden behind the islands and cliffs
+        if (programState->occlusionCulling)
+            occlusion.Collect();
+        else
+            occlusion.Reset();
+        std::fill(visible.begin(), visible.end(), 0);
+        queryStats.visible = queryStats.occluded = 0;
+        sceneBvh.QueryFrustum(extractFrustum(projection * view), [&](unsigned int box) {
+            if (beyondView[box] && !lit[box])
+                return;
+            if (occlusion.Occluded(box)) {
+                queryStats.occluded++;
+                return;
+            }
+            visible[box] = 1;
+            queryStats.visible++;
+        });
+        queryStats.culled = (unsigned int)visible.size() - queryStats.visible - queryStats.occluded;
+
+        // picks by box along the view direction, boxes around the camera are looked through
+        unsigned int pickedBox;
+        float pickedDistance;
+        bool picked = sceneBvh.Raycast(programState->camera.Position, programState->camera.Front, farPlane,
+                                       [](unsigned int, float boxDistance) { return boxDistance > 0.0f ? boxDistance : -1.0f; },
+                                       pickedBox, pickedDistance);
+        queryStats.picked = !picked ? "nothing" : boxModels[pickedBox] < 0 ? "water" : sceneFile.models[boxModels[pickedBox]].name;
+
+        // the deferred path lights with every lantern, each one's point light and its spot light from the base. A
+        // switched off spot light keeps its ambient like in the forward path, it only loses its volume when that is
+        // black too. Lights too dim to reach anything get no volume
+        lightVolumes.clear();
+        if (programState->deferredShading) {
+            for (unsigned int i = 0; i < lanterns.size(); i++) {
+                glm::vec3 lanternPosition = scene.Position(lanterns[i]);
+                glm::vec3 basePosition = scene.Position(lanternBases[i]);
+                PointLightBlock pointLight = sceneFile.pointLight;
+                pointLight.position = lanternPosition;
+                LightVolume pointVolume = pointLightVolume(pointLight);
+                if (pointVolume.radius > 0.0f)
+                    lightVolumes.push_back(pointVolume);
+                SpotLightBlock spotLight = sceneFile.spotLight;
+                spotLight.position = basePosition;
+                spotLight.direction = normalize(lanternPosition - basePosition);
+                LightVolume spotVolume = spotLightVolume(spotLight);
+                if (!programState->spotlight) {
+                    if (spotLight.ambient == glm::vec3(0.0f))
+                        continue;
+                    spotVolume.diffuse = spotVolume.specular = glm::vec3(0.0f);
+                }
+                if (spotVolume.radius > 0.0f)
+                    lightVolumes.push_back(spotVolume);
+            }
         }
-        objShader.setFloat("spotLights[1].constant", 1.0f);
-        objShader.setFloat("spotLights[1].linear", 0.09);
-        objShader.setFloat("spotLights[1].quadratic", 0.032);
-        objShader.setFloat("spotLights[1].cutOff", glm::cos(glm::radians(2.5f)));
-        objShader.setFloat("spotLights[1].outerCutOff", glm::cos(glm::radians(5.0f)));
+        queryStats.lights = (unsigned int)lightVolumes.size();
 
+        sceneUniforms.Upload();
+
+        // every draw of the frame is queued and then executed sorted by program, textures and depth
+        renderQueue.Begin(programState->camera.Position, farPlane);
 
         // rendering the loaded models
 
-        //island
-        glm::mat4 model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, 0.35f, 0.9f));
-        model = glm::scale(model, glm::vec3(0.1f));
-        objShader.setMat4("model", model);
-        island.Draw(objShader);
-
-        //bard
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-0.42f, 1.11f, 0.08f));
-        model = glm::scale(model, glm::vec3(0.24f));
-        model = glm::rotate(model, glm::radians(315.0f), glm::vec3(0,1,0));
-        model = glm::rotate(model, glm::radians(350.0f), glm::vec3(1,0,0));
-        objShader.setMat4("model", model);
-        bard.Draw(objShader);
-
-        //mountain island 1
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(20.0f, -7.0f, 20.0f));
-        model = glm::scale(model, glm::vec3(7.0, 7.0, 7.0));
-        objShader.setMat4("model", model);
-        mountain_island.Draw(objShader);
-
-        //mountain island 2
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-20.0f, -6.0f, 20.0f));
-        model = glm::scale(model, glm::vec3(6.0, 6.0, 6.0));
-        objShader.setMat4("model", model);
-        mountain_island.Draw(objShader);
-
-        //mountain island 3
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-20.0f, -8.0f, -20.0f));
-        model = glm::scale(model, glm::vec3(8.0, 8.0, 8.0));
-        objShader.setMat4("model", model);
-        mountain_island.Draw(objShader);
-
-        //underwater terrain island 1
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-15.0f, -5.5f, -15.0f));
-        model = glm::scale(model, glm::vec3(0.5f, 0.5f, 0.5f));
-        objShader.setMat4("model", model);
-        sand_terrain.Draw(objShader);
-
-        //lantern support 1
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-1.85f, 1.0f, 0.5f));
-        model = glm::scale(model, glm::vec3(0.25f, 0.25f, 0.25f));
-        model = glm::rotate(model, glm::radians(90.0f), glm::vec3(0,1,0));
-        objShader.setMat4("model", model);
-        support_beam.Draw(objShader);
-
-        //lantern support 2
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(1.05f, 1.0f, -0.5f));
-        model = glm::scale(model, glm::vec3(0.25f, 0.25f, 0.25f));
-        model = glm::rotate(model, glm::radians(90.0f), glm::vec3(0,1,0));
-        objShader.setMat4("model", model);
-        support_beam.Draw(objShader);
-
-        //boat
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-2.51f, 0.97f, -0.76f));
-        model = glm::scale(model, glm::vec3(0.38f));
-        model = glm::rotate(model, glm::radians(216.0f), glm::vec3(0,1,0));
-        objShader.setMat4("model", model);
-        boat.Draw(objShader);
-
-        //barrel the bard is sitting on
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-0.34f, 1.03f, 0.03f));
-        model = glm::scale(model, glm::vec3(0.065));
-        objShader.setMat4("model", model);
-        barrel.Draw(objShader);
-
-        //cliffs out of which the small waterfall is flowing
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.79f, -0.21f, 1.65f));
-        model = glm::scale(model, glm::vec3(0.190f));
-        model = glm::rotate(model, glm::radians(303.0f), glm::vec3(0,1,0));
-        objShader.setMat4("model", model);
-        cliffs.Draw(objShader);
-
-        //cliffs 2
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-0.31f, 0.09f, 2.65f));
-        model = glm::scale(model, glm::vec3(0.245f));
-        model = glm::rotate(model, glm::radians(49.5f), glm::vec3(0,1,0));
-        objShader.setMat4("model", model);
-        cliffs.Draw(objShader);
-
-        //granite protrusion in the cliff
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.22f, 2.14f, 1.37f));
-        model = glm::scale(model, glm::vec3(74.08f));
-        model = glm::rotate(model, glm::radians(244.0f), glm::vec3(0,1,0));
-        objShader.setMat4("model", model);
-        granite.Draw(objShader);
-
-        //granite 2
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-0.63f, 2.24f, 1.97f));
-        model = glm::scale(model, glm::vec3(74.08f));
-        model = glm::rotate(model, glm::radians(180.0f), glm::vec3(1,0,0));
-        model = glm::rotate(model, glm::radians(12.5f), glm::vec3(0,1,0));
-        objShader.setMat4("model", model);
-        granite.Draw(objShader);
-
-        /* template for a new object
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(programState->tempPosition));
-        model = glm::scale(model, glm::vec3(programState->tempScale));
-        model = glm::rotate(model, glm::radians(programState->tempRotation), glm::vec3(0,1,0));
-        objShader.setMat4("model", model);
-        x.Draw(objShader);
-         */
+        // the static objects draw with the matrices computed at load, models placed more than once are drawn
+        // instanced, one draw per mesh for all copies
+        int framebufferWidth, framebufferHeight;
+        glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+        float fovY = glm::radians(programState->camera.Zoom);
+        queryStats.triangles = queryStats.fullTriangles = 0;
+        unsigned int bound = 0;
+        for (unsigned int i = 0; i < sceneModels.size(); i++) {
+            Model &object = *sceneModels[i];
+            // with deferred shading the lit models fill the G-buffer instead, the emissive ones stay forward
+            bool deferredModel = programState->deferredShading && sceneModelShaders[i] == &objShader;
+            RenderPass modelPass = deferredModel ? RenderPass::Geometry : RenderPass::Opaque;
+            Shader &modelShader = deferredModel ? gBufferShader : *sceneModelShaders[i];
+            const TransformUniforms &modelUniforms = deferredModel ? gBufferTransformUniforms : sceneModelUniforms[i];
+            if (object.LodCount() > 1) {
+                // every placement gets the coarsest level whose error stays below the pixel limit, one changing
+                // level is drawn at both while the dither fades it over
+                for (unsigned int level = 0; level < MAX_LOD_LEVELS; level++) {
+                    lodInstances[level].clear();
+                    lodFades[level].clear();
+                }
+                for (const WorldTransform &instance : modelInstances[i]) {
+                    LodTransition &lod = lodStates[bound];
+                    if (!visible[bound++]) {
+                        lod.Hide();
+                        continue;
+                    }
+                    float pixelsPerUnit = lodPixelsPerUnit(object.bounds, instance.model, programState->camera.Position, fovY, (float)framebufferHeight);
+                    lod.Update(selectLod(object.lodErrors, pixelsPerUnit, programState->lodPixelError, lod.next), deltaTime);
+                    lodInstances[lod.level].push_back(instance);
+                    lodFades[lod.level].push_back(lod.fade);
+                    queryStats.triangles += object.TriangleCount(lod.level);
+                    if (lod.Fading()) {
+                        lodInstances[lod.next].push_back(instance);
+                        lodFades[lod.next].push_back(-lod.fade);
+                        queryStats.triangles += object.TriangleCount(lod.next);
+                    }
+                    queryStats.fullTriangles += object.TriangleCount();
+                }
+                for (unsigned int level = 0; level < object.LodCount(); level++)
+                    renderQueue.DrawModelInstanced(modelPass, modelShader, modelUniforms, lodInstances[level], object, level, &lodFades[level]);
+                continue;
+            }
+            visibleInstances[i].clear();
+            for (const WorldTransform &instance : modelInstances[i])
+                if (visible[bound++])
+                    visibleInstances[i].push_back(instance);
+            queryStats.triangles += object.TriangleCount() * (unsigned int)visibleInstances[i].size();
+            queryStats.fullTriangles += object.TriangleCount() * (unsigned int)visibleInstances[i].size();
+            if (visibleInstances[i].size() == 1)
+                renderQueue.DrawModel(modelPass, modelShader, modelUniforms, visibleInstances[i].front(), *sceneModels[i]);
+            else
+                renderQueue.DrawModelInstanced(modelPass, modelShader, modelUniforms, visibleInstances[i], *sceneModels[i]);
+        }
 
         //object rendering end, start of light source rendering
 
-        sourceShader.use();
-        sourceShader.setMat4("projection", projection);
-        sourceShader.setMat4("view", view);
-        sourceShader.setBool("celShading", false);
-
         //using the transformation matrices from earlier
-        sourceShader.setMat4("model", transMat1);
-        chinese_lantern.Draw(sourceShader);
-        sourceShader.setMat4("model", transMat2);
-        chinese_lantern.Draw(sourceShader);
+        for (vector<WorldTransform> &instances : lanternInstances)
+            instances.clear();
+        for (unsigned int i = 0; i < lanterns.size(); i++)
+            if (visible[staticBounds + i])
+                lanternInstances[sceneFile.lanterns[i].model].push_back(scene.Transform(lanterns[i]));
+        for (unsigned int i = 0; i < sceneModels.size(); i++) {
+            bool deferredModel = programState->deferredShading && sceneModelShaders[i] == &objShader;
+            renderQueue.DrawModelInstanced(deferredModel ? RenderPass::Geometry : RenderPass::Opaque,
+                                           deferredModel ? gBufferShader : *sceneModelShaders[i],
+                                           deferredModel ? gBufferTransformUniforms : sceneModelUniforms[i],
+                                           lanternInstances[i], *sceneModels[i]);
+        }
 
         //light source rendering end, start of waterfall rendering
 
-        waterfallShader.use();
-        waterfallShader.setMat4("projection", projection);
-        waterfallShader.setMat4("view", view);
-        waterfallShader.setFloat("currentFrame", currentFrame);
-        glBindVertexArray(waterfallVAO);
-        glBindTexture(GL_TEXTURE_2D, waterfallTexture);
-        for (unsigned int i = 0; i < waterfall_tiles.size(); i++)
-        {
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, waterfall_tiles[i]);
-
-            model = glm::rotate(model, glm::radians(45.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-            model = glm::scale(model, glm::vec3(0.25f, 0.25f, 0.25f));
-            if(i==3)
-                model = glm::rotate(model, 170.0f, (glm::vec3(1.0f, 0.0f, 0.0f)));
-            if(i==4)
-                model = glm::rotate(model, glm::radians(62.5f), (glm::vec3(1.0f, 0.0f, 0.0f)));
-            if(i==5)
-                model = glm::rotate(model, glm::radians(80.0f), (glm::vec3(1.0f, 0.0f, 0.0f)));
-            if(i==6)
-                model = glm::rotate(model, glm::radians(90.0f), (glm::vec3(1.0f, 0.0f, 0.0f)));
-            waterfallShader.setMat4("model", model);
-
-            glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-        }
+        if (!sceneFile.waterfallTiles.empty())
+            renderQueue.DrawElementsInstanced(RenderPass::Opaque, waterfallShader, sceneFile.waterfallTiles.front().position, waterfallVAO,
+                                              GL_TEXTURE_2D, waterfallTexture, 6, waterfallInstances.Count());
 
         //waterfall rendering end, start of vegetation rendering
 
-        discardShader.use();
-        discardShader.setMat4("projection", projection);
-        discardShader.setMat4("view", view);
-        glBindVertexArray(transparentVAO2);
-        glBindTexture(GL_TEXTURE_2D, transparentTexture);
-        for (unsigned int i = 0; i < vegetation.size(); i++)
-        {
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, vegetation[i]);
-            model = glm::rotate(model, (float)i*60.0f, glm::vec3(0.0, 0.1, 0.0));
-            discardShader.setMat4("model", model);
-            glDrawArrays(GL_TRIANGLES, 0, 6);
+        // the cards are only scattered again when the density or the scene changed
+        if (programState->grassDensity != uploadedGrassDensity) {
+            uploadedGrassDensity = std::max(programState->grassDensity, 1);
+            programState->grassDensity = uploadedGrassDensity;
+            grassInstances.Upload(scatterQuads(sceneFile.grassTufts, (unsigned int)uploadedGrassDensity, sceneFile.grassRadius));
         }
+        if (!sceneFile.grassTufts.empty())
+            renderQueue.DrawArraysInstanced(RenderPass::Cutout, discardShader, sceneFile.grassTufts.front().position, transparentVAO2,
+                                            GL_TEXTURE_2D, transparentTexture, 6, grassInstances.Count());
 
         //vegetation rendering end, start of ripple rendering
 
-        rippleShader.use();
-        rippleShader.setMat4("projection", projection);
-        rippleShader.setMat4("view", view);
-        rippleShader.setFloat("currentFrame", currentFrame);
-        glBindVertexArray(rippleVAO);
-        glBindTexture(GL_TEXTURE_2D, rippleTexture);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-0.76f, 1.001f, 0.87f));
-        model = glm::scale(model, glm::vec3(programState->tempScale));
-        model = glm::rotate(model, glm::radians(programState->tempRotation), glm::vec3(0,1,0));
-        rippleShader.setMat4("model", model);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-
-
-        //ripple rendering end, start of water rendering
-
-        //essentially unnecessary sorting, might change implementation so it's there just in case
-        std::map<float, glm::vec3> sorted;
-        for (unsigned int i = 0; i < waterSquares.size(); i++)
-        {
-            float distance = glm::length(programState->camera.Position - waterSquares[i]);
-            sorted[distance] = waterSquares[i];
+        glm::mat4 model;
+        for (const glm::vec3 &ripple : sceneFile.ripples) {
+            model = glm::mat4(1.0f);
+            model = glm::translate(model, ripple);
+            model = glm::scale(model, glm::vec3(programState->tempScale));
+            model = glm::rotate(model, glm::radians(programState->tempRotation), glm::vec3(0,1,0));
+            renderQueue.DrawArrays(RenderPass::Cutout, rippleShader, rippleModelUniform, model, rippleVAO, GL_TEXTURE_2D, rippleTexture, 6);
         }
 
-        waterShader.use();
-        waterShader.setVec3("viewPos", programState->camera.Position);
-
-        waterShader.setMat4("projection", projection);
-        waterShader.setMat4("view", view);
-        waterShader.setFloat("currentFrame", currentFrame);
-
+        //ripple rendering end, start of water rendering
 
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, diffuseMap);
-        glBindVertexArray(transparentVAO);
-        for (auto it = sorted.rbegin(); it != sorted.rend(); ++it)
-        {
+        // the transparent pass sorts the squares back to front
+        for (unsigned int i = 0; i < sceneFile.waterSquares.size(); i++) {
+            if (!visible[waterBounds + i])
+                continue;
             model = glm::mat4(1.0f);
-            model = glm::translate(model, it->second);
-            waterShader.setMat4("model", model);
-            glDrawArrays(GL_TRIANGLES, 0, 6);
+            model = glm::translate(model, sceneFile.waterSquares[i]);
+            renderQueue.DrawArrays(RenderPass::Transparent, waterShader, waterModelUniform, model, transparentVAO, GL_TEXTURE_2D, diffuseMap, 6);
         }
 
         //water rendering end, start of sky box rendering
 
-        skyboxShader.use();
-        skyboxShader.setInt("skybox", 0);
-
-        glDepthMask(GL_FALSE);
-        glDepthFunc(GL_LEQUAL);  // change depth function so depth test passes when values are equal to depth buffer's content
-        skyboxShader.use();
-        view = glm::mat4(glm::mat3(programState->camera.GetViewMatrix())); // remove translation from the view matrix
-        skyboxShader.setMat4("view", view);
-        skyboxShader.setMat4("projection", projection);
-
-        glBindVertexArray(skyboxVAO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubeMapTexture);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
-        glDepthMask(GL_TRUE);
-        glDepthFunc(GL_LESS); // set depth function back to default
+        // the sky pass runs with depth writes off and GL_LEQUAL, so the sky passes at the far plane
+        if (cubeMapTexture != 0)
+            renderQueue.DrawArrays(RenderPass::Sky, skyboxShader, Uniform(), glm::mat4(1.0f), skyboxVAO, GL_TEXTURE_CUBE_MAP, cubeMapTexture, 36);
+        // the depth pyramid is taken once the opaque and cutout passes are drawn, the water must not hide what is under it.
+        // The deferred path fills its G-buffer in the geometry pass and lights it into the window before the opaque pass
+        renderQueue.Execute([&](RenderPass pass) {
+            if (pass == RenderPass::Geometry && programState->deferredShading)
+                deferred.BeginGeometry(framebufferWidth, framebufferHeight);
+            if (pass == RenderPass::Opaque && programState->deferredShading)
+                deferred.Resolve(lightVolumes, view, projection, framebufferWidth, framebufferHeight);
+            if (pass == RenderPass::Sky && programState->occlusionCulling)
+                occlusion.Test(sceneBoxes, projection * view, framebufferWidth, framebufferHeight);
+        });
 
         if (programState->ImGuiEnabled)
-            DrawImGui(programState);
+            DrawImGui(programState, queryStats);
 
 
         glfwSwapBuffers(window);
@@ -779,6 +859,13 @@ int main() {
 
     programState->SaveToFile("resources/program_state.txt");
     delete programState;
+    textureRegistry().Clear();
+    sceneUniforms.Release();
+    occlusion.Release();
+    deferred.Release();
+    grassInstances.Release();
+    waterfallInstances.Release();
+    textureStreamer().Shutdown();
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
@@ -856,7 +943,7 @@ void scroll_callback(GLFWwindow *window, double xOffset, double yOffset) {
     programState->camera.ProcessMouseScroll((float)yOffset);
 }
 
-void DrawImGui(ProgramState *programState) {
+void DrawImGui(ProgramState *programState, const SceneQueryStats &queryStats) {
     ImGui_ImplOpenGL3_NewFrame();
     ImGui_ImplGlfw_NewFrame();
     ImGui::NewFrame();
@@ -868,6 +955,8 @@ void DrawImGui(ProgramState *programState) {
         ImGui::DragFloat3("Temp position", (float*)&programState->tempPosition, 0.01,-20.0, 20.0);
         ImGui::DragFloat("Temp scale", &programState->tempScale, 0.02, 0.02, 128.0);
         ImGui::DragFloat("Temp rotation", &programState->tempRotation, 0.5, 0.0, 360.0);
+        ImGui::SliderInt("Grass density", &programState->grassDensity, 1, 500);
+        ImGui::SliderFloat("LOD pixel error", &programState->lodPixelError, 0.25f, 8.0f);
 
         ImGui::End();
     }
@@ -879,11 +968,26 @@ void DrawImGui(ProgramState *programState) {
         ImGui::Text("(Yaw, Pitch): (%f, %f)", c.Yaw, c.Pitch);
         ImGui::Text("Camera front: (%f, %f, %f)", c.Front.x, c.Front.y, c.Front.z);
         ImGui::Checkbox("Camera mouse update", &programState->CameraMouseMovementUpdateEnabled);
+        ImGui::Text("Textures still streaming: %u", textureStreamer().Pending());
+        ImGui::Text("Culling: %u visible, %u culled, %u occluded", queryStats.visible, queryStats.culled, queryStats.occluded);
+        unsigned int inFrustum = queryStats.visible + queryStats.occluded;
+        ImGui::Text("Occlusion rejected %.0f%% of the draws in the frustum", inFrustum ? 100.0 * queryStats.occluded / inFrustum : 0.0);
+        ImGui::Checkbox("Occlusion culling", &programState->occlusionCulling);
+        ImGui::Checkbox("Deferred shading", &programState->deferredShading);
+        if (programState->deferredShading)
+            ImGui::Text("Deferred lights: %u", queryStats.lights);
+        ImGui::Text("Triangles: %u drawn, %u at full detail", queryStats.triangles, queryStats.fullTriangles);
+        ImGui::Text("Looking at: %s, %u objects in lantern light", queryStats.picked.c_str(), queryStats.lit);
+        ImGui::Text("State calls last frame: %u issued, %u filtered", renderState().IssuedCalls(), renderState().FilteredCalls());
+        ImGui::Text("Textures: %u unique, %.1f MB, %u shared requests", textureRegistry().TextureCount(),
+                    textureRegistry().GpuBytes() / (1024.0 * 1024.0), textureRegistry().SharedHits());
         ImGui::End();
     }
 
     ImGui::Render();
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+    // the ImGui backend sets GL state on its own
+    renderState().Invalidate();
 }
 
 void key_callback(GLFWwindow *window, int key, int scancode, int action, int mods) {
@@ -905,75 +1009,15 @@ void key_callback(GLFWwindow *window, int key, int scancode, int action, int mod
 
 unsigned int loadTexture(char const * path)
 {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(path, &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format = GL_RED;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-
-        if(nullptr != strstr(path, "grass.png")){
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-        }
-        else {
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        }
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
+    TextureSampling sampling;
+    if(nullptr != strstr(path, "grass.png"))
+        sampling.wrap = GL_CLAMP_TO_EDGE;
+    return textureRegistry().Acquire2D(path, sampling);
 }
 
 unsigned int loadCubeMap(vector<std::string> faces)
 {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
-
-    int width, height, nrChannels;
-    for (unsigned int i = 0; i < faces.size(); i++)
-    {
-        unsigned char *data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
-        if (data)
-        {
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-            stbi_image_free(data);
-        }
-        else
-        {
-            std::cout << "CubeMap texture failed to load at path: " << faces[i] << std::endl;
-            stbi_image_free(data);
-        }
-    }
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
-    return textureID;
-}
\ No newline at end of file
+    TextureSampling sampling;
+    sampling.wrap = GL_CLAMP_TO_EDGE;
+    return textureRegistry().AcquireCubeMap(faces, sampling);
+}
@@ -0,0 +1,204 @@
+// BVH micro-benchmark: builds the scene BVH over 10k and 100k random instances and times refits and the
+// frustum, sphere and ray queries, next to a linear cull of all boxes with the same SIMD box test.
+// Every frustum query is checked against a brute force test of all boxes.
+//
+// usage: bvh_benchmark [instances]...
+//        without arguments 10000 and 100000 instances are measured
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+// mesh.h, which bvh.h pulls in for MeshBounds, binds samplers through the Shader of shader_m.h
+#include <learnopengl/shader_m.h>
+#include <learnopengl/bvh.h>
+
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace std;
+
+static double millisecondsSince(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+struct Instance {
+    MeshBounds bounds;
+    glm::mat4 model;
+};
+
+// instances spread through a cube that grows with their count, so the density stays about the same
+static vector<Instance> randomInstances(unsigned int count, mt19937 &random)
+{
+    float side = 4.0f * cbrt((float)count);
+    uniform_real_distribution<float> position(-side * 0.5f, side * 0.5f), size(0.25f, 1.5f), angle(0.0f, 6.28318530718f);
+    vector<Instance> instances(count);
+    for (Instance &instance : instances)
+    {
+        glm::vec3 extent(size(random), size(random), size(random));
+        instance.bounds.min = -extent;
+        instance.bounds.max = extent;
+        instance.bounds.radius = glm::length(extent);
+        instance.model = glm::translate(glm::mat4(1.0f), glm::vec3(position(random), position(random), position(random)));
+        instance.model = glm::rotate(instance.model, angle(random), glm::vec3(0.0f, 1.0f, 0.0f));
+    }
+    return instances;
+}
+
+static vector<Frustum> randomFrustums(unsigned int count, float side, mt19937 &random)
+{
+    uniform_real_distribution<float> position(-side * 0.5f, side * 0.5f);
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 100.0f);
+    vector<Frustum> frustums;
+    for (unsigned int i = 0; i < count; i++)
+    {
+        glm::vec3 eye(position(random), position(random), position(random));
+        glm::vec3 target(position(random), position(random), position(random));
+        frustums.push_back(extractFrustum(projection * glm::lookAt(eye, target, glm::vec3(0.0f, 1.0f, 0.0f))));
+    }
+    return frustums;
+}
+
+// the box test of the BVH against every box
+static unsigned int bruteForceCount(const vector<Aabb> &boxes, const Frustum &frustum)
+{
+    unsigned int visible = 0;
+    for (const Aabb &box : boxes)
+    {
+        glm::vec3 center = (box.min + box.max) * 0.5f, extent = (box.max - box.min) * 0.5f;
+        bool inside = true;
+        for (const glm::vec4 &plane : frustum.planes)
+            inside = inside && plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w
+                               + fabs(plane.x) * extent.x + fabs(plane.y) * extent.y + fabs(plane.z) * extent.z >= 0.0f;
+        visible += inside ? 1 : 0;
+    }
+    return visible;
+}
+
+static void report(const char *what, double millis, unsigned int repetitions)
+{
+    cout << "  " << left << setw(28) << what << right << fixed << setprecision(3) << setw(10) << millis / repetitions * 1000.0
+         << " us" << endl;
+}
+
+static bool benchmark(unsigned int count)
+{
+    mt19937 random(count);
+    vector<Instance> instances = randomInstances(count, random);
+    float side = 4.0f * cbrt((float)count);
+    vector<Aabb> boxes;
+    for (const Instance &instance : instances)
+        boxes.push_back(worldBox(instance.bounds, instance.model));
+
+    cout << count << " instances" << endl;
+    Bvh bvh;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    bvh.Build(boxes);
+    report("build", millisecondsSince(start), 1);
+    cout << "  " << bvh.NodeCount() << " nodes" << endl;
+
+    // like the lanterns: a few boxes move, the tree is refit
+    const unsigned int refits = 100;
+    uniform_real_distribution<float> nudge(-0.1f, 0.1f);
+    start = chrono::steady_clock::now();
+    for (unsigned int i = 0; i < refits; i++)
+    {
+        for (unsigned int moved = 0; moved < 16; moved++)
+        {
+            unsigned int primitive = (i * 16 + moved) % count;
+            Aabb box = bvh.Box(primitive);
+            glm::vec3 offset(nudge(random), nudge(random), nudge(random));
+            bvh.SetBox(primitive, {box.min + offset, box.max + offset});
+        }
+        bvh.Refit();
+    }
+    report("refit, 16 moved", millisecondsSince(start), refits);
+    for (unsigned int i = 0; i < count; i++)
+        boxes[i] = bvh.Box(i);
+
+    const unsigned int views = 200;
+    vector<Frustum> frustums = randomFrustums(views, side, random);
+    unsigned long long visible = 0;
+    start = chrono::steady_clock::now();
+    for (const Frustum &frustum : frustums)
+        bvh.QueryFrustum(frustum, [&visible](unsigned int) { visible++; });
+    report("frustum query", millisecondsSince(start), views);
+    cout << "  " << visible / views << " visible per view on average" << endl;
+
+    BoxArrays linear;
+    linear.Resize(count);
+    for (unsigned int i = 0; i < count; i++)
+        linear.Set(i, boxes[i]);
+    unsigned long long linearVisible = 0;
+    start = chrono::steady_clock::now();
+    for (const Frustum &frustum : frustums)
+        for (unsigned int i = 0; i < count; i += 4)
+        {
+            unsigned int inside = linear.Inside4(frustum, (1u << 6) - 1, i);
+            for (unsigned int lane = 0; lane < 4 && i + lane < count; lane++)
+                linearVisible += (inside >> lane) & 1;
+        }
+    report("linear SIMD cull", millisecondsSince(start), views);
+
+    bool correct = true;
+    for (const Frustum &frustum : frustums)
+    {
+        unsigned int found = 0;
+        bvh.QueryFrustum(frustum, [&found](unsigned int) { found++; });
+        correct = correct && found == bruteForceCount(boxes, frustum);
+    }
+
+    const unsigned int queries = 10000;
+    uniform_real_distribution<float> position(-side * 0.5f, side * 0.5f), direction(-1.0f, 1.0f);
+    unsigned long long nearby = 0;
+    start = chrono::steady_clock::now();
+    for (unsigned int i = 0; i < queries; i++)
+        bvh.QuerySphere(glm::vec3(position(random), position(random), position(random)), 5.0f, [&nearby](unsigned int) { nearby++; });
+    report("sphere query, radius 5", millisecondsSince(start), queries);
+
+    unsigned int hits = 0;
+    start = chrono::steady_clock::now();
+    for (unsigned int i = 0; i < queries; i++)
+    {
+        glm::vec3 origin(position(random), position(random), position(random));
+        glm::vec3 ray = glm::normalize(glm::vec3(direction(random), direction(random), direction(random)) + glm::vec3(0.0f, 0.0f, 1e-3f));
+        unsigned int primitive;
+        float distance;
+        hits += bvh.Raycast(origin, ray, 100.0f, [](unsigned int, float boxDistance) { return boxDistance; }, primitive, distance) ? 1 : 0;
+    }
+    report("ray query, nearest box", millisecondsSince(start), queries);
+    cout << "  " << nearby / queries << " boxes near a point, " << hits << " of " << queries << " rays hit" << endl;
+    correct = correct && linearVisible == visible;
+    cout << "  frustum queries " << (correct ? "match" : "DO NOT match") << " the brute force test" << endl;
+    return correct;
+}
+
+int main(int argc, char **argv)
+{
+    // every argument has to be a positive number of instances, strtoul would read anything else as 0 or wrap it
+    vector<unsigned int> counts;
+    for (int i = 1; i < argc; i++)
+    {
+        char *end = nullptr;
+        errno = 0;
+        unsigned long count = argv[i][0] >= '0' && argv[i][0] <= '9' ? strtoul(argv[i], &end, 10) : 0;
+        if (!end || *end != '\0' || errno == ERANGE || count == 0 || count > UINT_MAX)
+        {
+            cout << "usage: bvh_benchmark [instances]..., instances being a positive number" << endl;
+            return 1;
+        }
+        counts.push_back((unsigned int)count);
+    }
+    if (counts.empty())
+        counts = {10000, 100000};
+    bool correct = true;
+    for (unsigned int count : counts)
+        correct = benchmark(count) && correct;
+    return correct ? 0 : 1;
+}
@@ -0,0 +1,131 @@
+// Offline texture cooker: compresses every image it is given (or finds in the given directories) to BC1/BC3
+// with a full mip chain and writes it next to the source as <image>.rgtex, where the texture streamer picks it up.
+//
+// usage: texture_cooker [--force] <image or directory>...
+//        without arguments everything under resources/ is cooked
+
+#include <stb_image.h>
+
+#include <learnopengl/cooked_texture.h>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+static bool isImage(const string &path)
+{
+    static const char *extensions[] = {".png", ".jpg", ".jpeg", ".tga", ".bmp"};
+    string lower = path;
+    transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return (char)tolower(c); });
+    for (const char *extension : extensions)
+    {
+        size_t length = strlen(extension);
+        if (lower.size() > length && lower.compare(lower.size() - length, length, extension) == 0)
+            return true;
+    }
+    return false;
+}
+
+static bool isDirectory(const string &path)
+{
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+static void collectImages(const string &path, vector<string> &images)
+{
+    if (!isDirectory(path))
+    {
+        if (isImage(path))
+            images.push_back(path);
+        return;
+    }
+    DIR *directory = opendir(path.c_str());
+    if (!directory)
+        return;
+    while (dirent *entry = readdir(directory))
+    {
+        string name = entry->d_name;
+        if (name != "." && name != "..")
+            collectImages(path + '/' + name, images);
+    }
+    closedir(directory);
+}
+
+static bool cook(const string &source)
+{
+    int width, height, channels;
+    unsigned char *pixels = stbi_load(source.c_str(), &width, &height, &channels, 4);
+    if (!pixels)
+    {
+        cout << "  failed to load " << source << ": " << stbi_failure_reason() << endl;
+        return false;
+    }
+    vector<unsigned char> rgba(pixels, pixels + (size_t)width * height * 4);
+    stbi_image_free(pixels);
+
+    bool hasAlpha = false;
+    if (channels == 2 || channels == 4)
+        for (size_t i = 3; i < rgba.size() && !hasAlpha; i += 4)
+            hasAlpha = rgba[i] != 255;
+
+    if (!writeCookedTexture(cookedPathFor(source), rgba, width, height, hasAlpha, COOKED_FLIPPED_VERTICALLY))
+    {
+        cout << "  failed to write " << cookedPathFor(source) << endl;
+        return false;
+    }
+    cout << "  " << source << " (" << width << "x" << height << ", " << (hasAlpha ? "BC3" : "BC1") << ")" << endl;
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    bool force = false;
+    vector<string> roots;
+    for (int i = 1; i < argc; i++)
+    {
+        string argument = argv[i];
+        if (argument == "--force")
+            force = true;
+        else
+            roots.push_back(argument);
+    }
+    if (roots.empty())
+        roots.push_back("resources");
+
+    // the runtime flips every image on load, so the cooked data is stored flipped as well
+    stbi_set_flip_vertically_on_load(true);
+
+    vector<string> images;
+    for (const string &root : roots)
+        collectImages(root, images);
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    unsigned int cooked = 0, skipped = 0, failed = 0;
+    cout << "Cooking " << images.size() << " textures" << endl;
+    for (const string &image : images)
+    {
+        // files that no longer read back, or were cooked with the other orientation, are cooked again
+        CookedTexture existing;
+        if (!force && cookedTextureUpToDate(image, cookedPathFor(image)) && readCookedTexture(cookedPathFor(image), existing, true))
+        {
+            skipped++;
+            continue;
+        }
+        if (cook(image))
+            cooked++;
+        else
+            failed++;
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << cooked << " cooked, " << skipped << " up to date, " << failed << " failed in " << seconds << " s" << endl;
+    return failed == 0 ? 0 : 1;
+}